@@ -0,0 +1,239 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "mng_utils.h"
+#include "set_cover.h"
+#include "minimum_navigable_graph.h"
+#include "nn_descent.h"
+#include "partitioned_mng.h"
+
+namespace MNG {
+    // Peak memory and running time of each way to build a graph, estimated before anything quadratic is allocated
+    // Memory follows the buffers each path allocates, and time extrapolates the cost of each phase measured on a sample
+    enum class build_path {
+        greedy,      // SetCoverAdjlists::adjlists_greedy on the full matrices
+        sampling,    // SetCoverAdjlists::adjlists_sampling on the full matrices
+        quadratic,   // minimum_navigable_graph on the full matrices
+        cached,      // minimum_navigable_graph on matrices mapped from a MatrixCache
+        knn,         // minimum_navigable_graph on approximate nearest neighbor lists
+        partitioned  // partitioned_navigable_graph
+    };
+
+    inline const char *build_path_name(build_path path) {
+        switch (path) {
+            case build_path::greedy: return "greedy";
+            case build_path::sampling: return "sampling";
+            case build_path::quadratic: return "mng";
+            case build_path::cached: return "mng-cached";
+            case build_path::knn: return "knn";
+            default: return "partitioned";
+        }
+    }
+
+    struct plan_parameters {
+        size_t memory_budget;             // Bytes the build may use, including the points
+        size_t calibration_size;          // Points in the sample the phase costs are measured on
+        bool cached_matrices;             // Whether a MatrixCache already holds the matrices of these points
+        double disk_bandwidth;            // Bytes per second the cached matrices are read at when they exceed the budget
+        NNDescent::parameters knn_params;
+        partition_parameters partition_params;
+
+        plan_parameters() : memory_budget(-1ULL), calibration_size(1000), cached_matrices(false), disk_bandwidth(1e9) {}
+    };
+
+    struct phase_costs {
+        // Seconds per unit of work with all workers, measured on the sample
+        double distances = 0;   // Per pair and dimension of the distance matrix
+        double sort = 0;        // Per entry of the permutation matrix and level of the sort
+        double rank = 0;        // Per entry of the rank matrix
+        double cover = 0;       // Per n^2 log n of the quadratic set cover
+        double sampling = 0;    // Per n^2 log n of the sampling set cover
+        double greedy = 0;      // Per n^3 of the greedy set cover
+        double knn = 0;         // Per n log n of nearest neighbor descent and its truncated set cover
+        double calibration_time = 0;
+    };
+
+    struct path_estimate {
+        build_path path;
+        size_t peak_bytes = 0;
+        double seconds = 0;
+        bool available = true; // False when the path needs something this run does not have, such as a matrix cache
+        bool fits = false;
+        std::string note;
+    };
+
+    struct build_plan {
+        size_t memory_budget = 0;
+        std::vector<path_estimate> estimates;
+        int chosen = -1; // Index into estimates of the fastest path that fits, or -1 when none does
+
+        const path_estimate *choice() const {
+            return chosen < 0 ? nullptr : &estimates[chosen];
+        }
+
+        const path_estimate *find(build_path path) const {
+            for (auto &estimate : estimates) {
+                if (estimate.path == path) return &estimate;
+            }
+            return nullptr;
+        }
+    };
+
+    inline double log2_size(size_t n) {
+        return std::max(1.0, std::log2((double)n));
+    }
+
+    template <typename index_t, typename value_t>
+    phase_costs calibrate_build(PointSet<value_t> &points, const plan_parameters &params = plan_parameters()) {
+        // Time every phase on an evenly spaced sample of the points and divide by the work each phase does
+        // The greedy set cover is cubic, so it is timed on a quarter of the sample
+        parlay::internal::timer timer;
+        timer.start();
+        phase_costs costs;
+        size_t n = points.size();
+        size_t d = points.dimension();
+        size_t m = std::max<size_t>(std::min(params.calibration_size, n), 2);
+        auto sample_ids = parlay::tabulate(m, [&](size_t i) { return (index_t)(i * n / m); });
+        PointSet<value_t> sample(points, sample_ids);
+        double logm = log2_size(m);
+
+        parlay::internal::timer phase;
+        phase.start();
+        DistanceMatrix<value_t> distances(sample);
+        costs.distances = phase.next_time() / (m * (m - 1) / 2.0 * d);
+        PermutationMatrix<index_t> permutations(distances);
+        costs.sort = phase.next_time() / (m * (double)m * logm);
+        RankMatrix<index_t> ranks(distances, permutations);
+        costs.rank = phase.next_time() / (m * (double)m);
+        minimum_navigable_graph<index_t>(m, permutations, ranks);
+        costs.cover = phase.next_time() / (m * (double)m * logm);
+        {
+            SetCoverAdjlists<value_t> set_cover(sample, std::move(distances), std::move(permutations), std::move(ranks));
+            phase.next_time();
+            set_cover.adjlists_sampling();
+            costs.sampling = phase.next_time() / (m * (double)m * logm);
+        }
+
+        size_t g = std::max<size_t>(m / 4, 2);
+        PointSet<value_t> greedy_sample(sample, 0, g);
+        SetCoverAdjlists<value_t> greedy_cover(greedy_sample);
+        phase.next_time();
+        greedy_cover.adjlists_greedy();
+        costs.greedy = phase.next_time() / ((double)g * g * g);
+
+        auto neighbors = NNDescent::knn_graph<index_t>(sample, params.knn_params);
+        minimum_navigable_graph<index_t, value_t>(sample, neighbors);
+        costs.knn = phase.next_time() / (m * logm);
+
+        costs.calibration_time = timer.next_time();
+        return costs;
+    }
+
+    template <typename index_t, typename value_t>
+    build_plan plan_build(size_t n, size_t d, const phase_costs &costs, const plan_parameters &params = plan_parameters()) {
+        // Estimate every path and choose the fastest one whose peak fits the budget
+        size_t workers = parlay::num_workers();
+        double logn = log2_size(n);
+        double n2 = (double)n * n;
+        size_t v = sizeof(value_t), idx = sizeof(index_t);
+        size_t points_bytes = n * d * v;
+        // Final adjacency lists, taking the average degree as twice log n
+        auto adjlist_bytes = [&](size_t size) { return size * (sizeof(std::vector<index_t>) + 2 * (size_t)std::ceil(log2_size(size)) * idx); };
+        auto matrix_bytes = [&](size_t size) { return (size_t)size * size * (v + 2 * idx); };
+        auto matrix_time = [&](size_t size) {
+            double s2 = (double)size * size;
+            return s2 / 2 * d * costs.distances + s2 * log2_size(size) * costs.sort + s2 * costs.rank;
+        };
+        // The first round of the degree search keeps every row of the permutations as uncovered points,
+        // and each worker's vote tables grow with the instance it works on
+        auto cover_bytes = [&](size_t size) { return (size_t)size * size * idx + workers * size * 64 + adjlist_bytes(size); };
+        auto cover_time = [&](size_t size) { return (double)size * size * log2_size(size) * costs.cover; };
+
+        build_plan plan;
+        plan.memory_budget = params.memory_budget;
+        auto add = [&](build_path path, double bytes, double seconds) -> path_estimate & {
+            path_estimate estimate;
+            estimate.path = path;
+            estimate.peak_bytes = (size_t)std::min(bytes, 1e19);
+            estimate.seconds = seconds;
+            plan.estimates.push_back(estimate);
+            return plan.estimates.back();
+        };
+
+        // Each greedy instance lists, for every target, the sets covering it, which averages n^2 / 2 ids per worker
+        add(build_path::greedy, points_bytes + matrix_bytes(n) + workers * (n2 / 2 * idx + n * sizeof(std::vector<index_t>)) + adjlist_bytes(n),
+            matrix_time(n) + n2 * n * costs.greedy);
+        add(build_path::sampling, points_bytes + matrix_bytes(n) + workers * n * 3 * idx + adjlist_bytes(n),
+            matrix_time(n) + n2 * logn * costs.sampling);
+        add(build_path::quadratic, points_bytes + matrix_bytes(n) + cover_bytes(n), matrix_time(n) + cover_time(n));
+
+        // Mapped matrices live in the page cache, so only the pages the set cover reads count, and those that do not fit are read from disk
+        size_t mapped_bytes = n2 * 2 * idx;
+        size_t cached_bytes = points_bytes + cover_bytes(n);
+        auto &cached = add(build_path::cached, cached_bytes + mapped_bytes, cover_time(n));
+        if (!params.cached_matrices) {
+            cached.available = false;
+            cached.note = "needs a matrix cache of these points";
+        }
+        else if (cached_bytes + mapped_bytes > params.memory_budget && cached_bytes <= params.memory_budget) {
+            cached.peak_bytes = params.memory_budget;
+            cached.seconds += mapped_bytes / params.disk_bandwidth;
+            cached.note = "pages matrices from disk";
+        }
+
+        // Nearest neighbor descent keeps its lists and sampled candidates, then each truncated row holds k + 1 ids,
+        // k + 1 rank pairs, and up to k + 1 uncovered points, after sorting k + 1 distances and ids per point
+        size_t k = std::min(params.knn_params.k, n - 1);
+        size_t neighbor_bytes = sizeof(NNDescent::neighbor<index_t, value_t>);
+        size_t knn_bytes = n * ((k + 1) * neighbor_bytes + 6 * params.knn_params.max_candidates * idx + 5 * sizeof(std::vector<index_t>) + sizeof(std::mutex));
+        size_t truncated_bytes = n * ((k + 1) * (4 * idx + v + idx) + 2 * sizeof(size_t));
+        add(build_path::knn, points_bytes + knn_bytes + truncated_bytes + workers * (k + 1) * 64 + adjlist_bytes(n), n * logn * costs.knn);
+
+        // Partitions are never larger than the cap the partitioned build enforces, and every partition keeps a copy of its points
+        const partition_parameters &partition = params.partition_params;
+        size_t num_partitions = std::max<size_t>(1, (n * partition.overlap + partition.partition_size - 1) / partition.partition_size);
+        size_t largest = std::min(n, partition_cap(partition));
+        size_t concurrent = std::min({num_partitions, partition.concurrent_partitions, workers});
+        auto &partitioned = add(build_path::partitioned,
+            points_bytes * (1 + partition.overlap) + concurrent * (matrix_bytes(largest) + cover_bytes(largest)) + adjlist_bytes(n),
+            num_partitions * (matrix_time(partition.partition_size) + cover_time(partition.partition_size)) + (double)n * num_partitions * d * costs.distances);
+        if (num_partitions == 1) partitioned.note = "one partition holds every point";
+
+        for (size_t i = 0; i < plan.estimates.size(); i++) {
+            auto &estimate = plan.estimates[i];
+            estimate.fits = estimate.available && estimate.peak_bytes <= params.memory_budget;
+            if (estimate.fits && (plan.chosen < 0 || estimate.seconds < plan.estimates[plan.chosen].seconds)) {
+                plan.chosen = i;
+            }
+        }
+        return plan;
+    }
+
+    inline void print_plan(std::ostream &out, const build_plan &plan) {
+        out << "Build plan";
+        if (plan.memory_budget != -1ULL) out << " for a budget of " << plan.memory_budget / 1e9 << " GB";
+        out << std::endl;
+        for (size_t i = 0; i < plan.estimates.size(); i++) {
+            auto &estimate = plan.estimates[i];
+            out << ((int)i == plan.chosen ? "  * " : "    ") << std::left << std::setw(12) << build_path_name(estimate.path) << std::right
+                << std::setw(12) << std::fixed << std::setprecision(3) << estimate.peak_bytes / 1e9 << " GB"
+                << std::setw(14) << estimate.seconds << " s" << std::defaultfloat
+                << (estimate.available ? (estimate.fits ? "" : "  over budget") : "  unavailable")
+                << (estimate.note.empty() ? "" : "  (" + estimate.note + ")") << std::endl;
+        }
+        if (plan.chosen < 0) out << "No construction path fits the budget" << std::endl;
+    }
+}
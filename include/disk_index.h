@@ -0,0 +1,336 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+
+#include "point_set.h"
+#include "entry_points.h"
+
+// The index file is a header sector followed by node records packed into 4 KB sectors
+// A record holds a vertex's full vector, its degree and max_degree neighbor slots, and never straddles a sector
+// unless it is larger than one, in which case it starts on its own sector
+constexpr size_t SECTOR_SIZE = 4096;
+constexpr uint64_t DISK_INDEX_MAGIC = 0x4e4156494e444558ULL;
+
+struct disk_index_header {
+    uint64_t magic;
+    uint64_t num_points;
+    uint64_t dims;
+    uint64_t max_degree;
+    uint64_t record_size;
+    uint64_t records_per_sector; // Zero when a record spans sectors_per_record sectors
+    uint64_t sectors_per_record;
+    uint64_t num_pivots;
+    // Followed by num_pivots 32-bit entry point ids within the header sector
+};
+
+inline disk_index_header disk_index_layout(size_t num_points, size_t dims, size_t max_degree, size_t value_size) {
+    disk_index_header header;
+    header.magic = DISK_INDEX_MAGIC;
+    header.num_points = num_points;
+    header.dims = dims;
+    header.max_degree = max_degree;
+    header.record_size = dims * value_size + (max_degree + 1) * sizeof(uint32_t);
+    header.records_per_sector = SECTOR_SIZE / header.record_size;
+    header.sectors_per_record = header.records_per_sector > 0 ? 1 : (header.record_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    header.num_pivots = 0;
+    return header;
+}
+
+template <typename value_t>
+void write_disk_index(std::string filename, PointSet<value_t> &points, const std::vector<std::vector<uint32_t>> &adjlists, const EntryPoints &entry) {
+    size_t max_degree = 0;
+    for (auto &adjlist : adjlists) {
+        max_degree = std::max(max_degree, adjlist.size());
+    }
+    disk_index_header header = disk_index_layout(points.size(), points.dimension(), max_degree, sizeof(value_t));
+    header.num_pivots = std::min(entry.size(), (SECTOR_SIZE - sizeof(header)) / sizeof(uint32_t));
+
+    int fd = open(filename.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: could not create disk index " << filename << std::endl;
+        std::abort();
+    }
+    std::vector<char> sector(SECTOR_SIZE, 0);
+    std::memcpy(sector.data(), &header, sizeof(header));
+    std::memcpy(sector.data() + sizeof(header), entry.pivots.data(), header.num_pivots * sizeof(uint32_t));
+    if (pwrite(fd, sector.data(), SECTOR_SIZE, 0) != SECTOR_SIZE) {
+        std::cerr << "Error: could not write disk index " << filename << std::endl;
+        std::abort();
+    }
+
+    // Write the records in chunks of sectors to keep the staging buffer small
+    size_t n = points.size();
+    size_t d = points.dimension();
+    size_t records_per_chunk = header.records_per_sector > 0 ? header.records_per_sector * 256 : 16;
+    size_t sectors_per_chunk = header.records_per_sector > 0 ? 256 : 16 * header.sectors_per_record;
+    std::vector<char> chunk(sectors_per_chunk * SECTOR_SIZE);
+    for (size_t start = 0; start < n; start += records_per_chunk) {
+        size_t end = std::min(start + records_per_chunk, n);
+        std::fill(chunk.begin(), chunk.end(), 0);
+        parlay::parallel_for(start, end, [&](size_t i) {
+            size_t j = i - start;
+            char *record = header.records_per_sector > 0
+                ? chunk.data() + (j / header.records_per_sector) * SECTOR_SIZE + (j % header.records_per_sector) * header.record_size
+                : chunk.data() + j * header.sectors_per_record * SECTOR_SIZE;
+            std::memcpy(record, points[i].data(), d * sizeof(value_t));
+            uint32_t degree = adjlists[i].size();
+            std::memcpy(record + d * sizeof(value_t), &degree, sizeof(uint32_t));
+            std::memcpy(record + d * sizeof(value_t) + sizeof(uint32_t), adjlists[i].data(), degree * sizeof(uint32_t));
+        });
+        size_t offset = SECTOR_SIZE + (header.records_per_sector > 0 ? start / header.records_per_sector : start * header.sectors_per_record) * SECTOR_SIZE;
+        if (pwrite(fd, chunk.data(), chunk.size(), offset) != (ssize_t)chunk.size()) {
+            std::cerr << "Error: could not write disk index " << filename << std::endl;
+            std::abort();
+        }
+    }
+    close(fd);
+}
+
+class SectorReader {
+    // Reads batches of sector-aligned ranges into aligned buffers
+    // With io_uring the whole batch is in flight at once, otherwise the reads are issued one by one with pread
+    int fd;
+    size_t depth;
+#ifdef USE_IO_URING
+    io_uring ring;
+#endif
+
+public:
+    struct request {
+        uint64_t offset;
+        uint64_t length;
+        char *buffer;
+    };
+
+    SectorReader(int fd, size_t depth) : fd(fd), depth(depth) {
+#ifdef USE_IO_URING
+        if (io_uring_queue_init(depth, &ring, 0) < 0) {
+            std::cerr << "Error: could not create io_uring queue" << std::endl;
+            std::abort();
+        }
+#endif
+    }
+
+    SectorReader(const SectorReader &) = delete;
+    SectorReader &operator=(const SectorReader &) = delete;
+
+    ~SectorReader() {
+#ifdef USE_IO_URING
+        io_uring_queue_exit(&ring);
+#endif
+    }
+
+    void read_remaining(const request &r, uint64_t done) {
+        // Finish a request that returned fewer bytes than asked, which is only an error once the file ends or a read fails
+        while (done < r.length) {
+            ssize_t bytes = pread(fd, r.buffer + done, r.length - done, r.offset + done);
+            if (bytes <= 0) {
+                std::cerr << "Error: disk index read failed: " << (bytes < 0 ? std::strerror(errno) : "unexpected end of file") << std::endl;
+                std::abort();
+            }
+            done += bytes;
+        }
+    }
+
+    void read(std::vector<request> &requests) {
+        for (size_t start = 0; start < requests.size(); start += depth) {
+            size_t end = std::min(start + depth, requests.size());
+#ifdef USE_IO_URING
+            for (size_t i = start; i < end; i++) {
+                io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+                io_uring_prep_read(sqe, fd, requests[i].buffer, requests[i].length, requests[i].offset);
+                io_uring_sqe_set_data(sqe, &requests[i]);
+            }
+            io_uring_submit(&ring);
+            for (size_t i = start; i < end; i++) {
+                io_uring_cqe *cqe;
+                io_uring_wait_cqe(&ring, &cqe);
+                if (cqe->res < 0) {
+                    std::cerr << "Error: disk index read failed: " << std::strerror(-cqe->res) << std::endl;
+                    std::abort();
+                }
+                read_remaining(*(const request *)io_uring_cqe_get_data(cqe), cqe->res);
+                io_uring_cqe_seen(&ring, cqe);
+            }
+#else
+            for (size_t i = start; i < end; i++) {
+                read_remaining(requests[i], 0);
+            }
+#endif
+        }
+    }
+};
+
+struct disk_search_result {
+    uint32_t id;
+    uint32_t ios;       // Sector-aligned reads issued
+    uint32_t estimates; // Distances estimated from in-memory codes
+    uint32_t exact;     // Full-precision distances computed from read records
+};
+
+template <typename value_t, typename Quantizer>
+class DiskIndex {
+    // Only the quantized codes and the entry points live in memory
+    // Searches expand a beam of the closest unexpanded candidates by estimated distance, reading their records together
+    int fd;
+    disk_index_header header;
+    std::vector<uint32_t> pivots;
+    const Quantizer &quantizer;
+    size_t beam_width;
+    std::vector<std::unique_ptr<SectorReader>> readers;
+
+    static char *aligned_buffer(size_t size) {
+        return (char *)std::aligned_alloc(SECTOR_SIZE, (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE);
+    }
+
+public:
+    DiskIndex(std::string filename, const Quantizer &quantizer, size_t beam_width = 4) : quantizer(quantizer), beam_width(beam_width) {
+        // Bypass the page cache when the file system allows it, so reads measure the device
+        fd = open(filename.data(), O_RDONLY | O_DIRECT);
+        if (fd < 0) fd = open(filename.data(), O_RDONLY);
+        if (fd < 0) {
+            std::cout << "Disk index " << filename << " not found" << std::endl;
+            std::abort();
+        }
+        char *sector = aligned_buffer(SECTOR_SIZE);
+        if (pread(fd, sector, SECTOR_SIZE, 0) != SECTOR_SIZE) {
+            std::cerr << "Error: could not read disk index header" << std::endl;
+            std::abort();
+        }
+        std::memcpy(&header, sector, sizeof(header));
+        if (header.magic != DISK_INDEX_MAGIC || header.num_points != quantizer.size()) {
+            std::cerr << "Error: " << filename << " is not a disk index for these codes" << std::endl;
+            std::abort();
+        }
+        pivots.resize(header.num_pivots);
+        std::memcpy(pivots.data(), sector + sizeof(header), header.num_pivots * sizeof(uint32_t));
+        std::free(sector);
+
+        for (size_t i = 0; i < parlay::num_workers(); i++) {
+            readers.emplace_back(new SectorReader(fd, beam_width));
+        }
+    }
+
+    DiskIndex(const DiskIndex &) = delete;
+    DiskIndex &operator=(const DiskIndex &) = delete;
+
+    ~DiskIndex() {
+        readers.clear();
+        close(fd);
+    }
+
+    size_t size() const {
+        return header.num_points;
+    }
+
+    size_t read_size() const {
+        return header.sectors_per_record * SECTOR_SIZE;
+    }
+
+    disk_search_result search(const value_t *query, size_t list_size) {
+        // Expand the closest unexpanded candidates beam_width at a time until the list_size closest are all expanded
+        // The list always holds at least the source, so a list_size of zero searches like a list_size of one
+        list_size = std::max<size_t>(list_size, 1);
+        size_t d = header.dims;
+        auto prepared = quantizer.prepare(query);
+        disk_search_result result = {0, 0, 0, 0};
+
+        struct candidate {
+            value_t dist;
+            uint32_t id;
+            bool expanded;
+        };
+        std::vector<candidate> candidates;
+        std::unordered_set<uint32_t> seen;
+        auto insert = [&](uint32_t v) {
+            if (!seen.insert(v).second) return;
+            value_t dist = quantizer.distance(prepared, v);
+            result.estimates++;
+            if (candidates.size() >= list_size && !(dist < candidates.back().dist)) return;
+            candidate c = {dist, v, false};
+            candidates.insert(std::upper_bound(candidates.begin(), candidates.end(), c, [](const candidate &a, const candidate &b) {
+                return a.dist < b.dist;
+            }), c);
+            if (candidates.size() > list_size) candidates.pop_back();
+        };
+
+        // Start from the pivot closest by estimated distance, which needs no reads
+        uint32_t source = pivots.empty() ? 0 : pivots[0];
+        value_t source_dist = std::numeric_limits<value_t>::max();
+        for (uint32_t pivot : pivots) {
+            value_t dist = quantizer.distance(prepared, pivot);
+            result.estimates++;
+            if (dist < source_dist) {
+                source = pivot;
+                source_dist = dist;
+            }
+        }
+        insert(source);
+
+        SectorReader &reader = *readers[parlay::worker_id()];
+        char *buffers = aligned_buffer(beam_width * read_size());
+        std::vector<SectorReader::request> requests;
+        std::vector<size_t> beam;
+        value_t best_dist = std::numeric_limits<value_t>::max();
+        while (true) {
+            beam.clear();
+            for (size_t i = 0; i < candidates.size() && beam.size() < beam_width; i++) {
+                if (!candidates[i].expanded) beam.push_back(i);
+            }
+            if (beam.empty()) break;
+
+            requests.clear();
+            for (size_t b = 0; b < beam.size(); b++) {
+                uint32_t v = candidates[beam[b]].id;
+                uint64_t sector = header.records_per_sector > 0 ? v / header.records_per_sector : v * header.sectors_per_record;
+                requests.push_back({SECTOR_SIZE * (1 + sector), read_size(), buffers + b * read_size()});
+                candidates[beam[b]].expanded = true;
+            }
+            reader.read(requests);
+            result.ios += requests.size();
+
+            // Copy the beam's records before inserting candidates, which shifts positions in the list
+            std::vector<uint32_t> neighbors;
+            for (size_t b = 0; b < beam.size(); b++) {
+                uint32_t v = candidates[beam[b]].id;
+                const char *record = buffers + b * read_size() + (header.records_per_sector > 0 ? (v % header.records_per_sector) * header.record_size : 0);
+                value_t dist = squared_distance((const value_t *)record, query, d);
+                result.exact++;
+                if (dist < best_dist) {
+                    result.id = v;
+                    best_dist = dist;
+                }
+                uint32_t degree;
+                std::memcpy(&degree, record + d * sizeof(value_t), sizeof(uint32_t));
+                const uint32_t *adjlist = (const uint32_t *)(record + d * sizeof(value_t) + sizeof(uint32_t));
+                neighbors.insert(neighbors.end(), adjlist, adjlist + degree);
+            }
+            for (uint32_t u : neighbors) {
+                insert(u);
+            }
+        }
+        std::free(buffers);
+        return result;
+    }
+};
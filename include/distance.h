@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+// Number of independent partial sums kept by the distance kernels
+// Splitting the accumulator lets the compiler vectorize the loop without reassociating floating point additions
+constexpr size_t DISTANCE_LANES = 8;
+
+// Number of dimensions accumulated between checks against the bound in squared_distance_bounded
+// Checking every lane block would serialize the loop on the horizontal sum, so several blocks are summed between checks
+constexpr size_t ABANDON_STRIDE = 4 * DISTANCE_LANES;
+
+template <typename value_t>
+inline value_t squared_distance(const value_t *a, const value_t *b, size_t d) {
+    value_t partial[DISTANCE_LANES] = {};
+    size_t i = 0;
+    for (; i + DISTANCE_LANES <= d; i += DISTANCE_LANES) {
+        for (size_t j = 0; j < DISTANCE_LANES; j++) {
+            value_t diff = a[i + j] - b[i + j];
+            partial[j] += diff * diff;
+        }
+    }
+    value_t dist = 0;
+    for (size_t j = 0; j < DISTANCE_LANES; j++) {
+        dist += partial[j];
+    }
+    for (; i < d; i++) {
+        value_t diff = a[i] - b[i];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+template <typename value_t>
+inline value_t squared_distance_bounded(const value_t *a, const value_t *b, size_t d, value_t bound) {
+    // Stop accumulating once the partial sum exceeds bound and return it, which is then only a lower bound on the distance
+    // Distances within the bound are summed in the same order as squared_distance, so they are bitwise identical
+    value_t partial[DISTANCE_LANES] = {};
+    size_t i = 0;
+    while (i + ABANDON_STRIDE <= d) {
+        for (size_t end = i + ABANDON_STRIDE; i < end; i += DISTANCE_LANES) {
+            for (size_t j = 0; j < DISTANCE_LANES; j++) {
+                value_t diff = a[i + j] - b[i + j];
+                partial[j] += diff * diff;
+            }
+        }
+        value_t dist = 0;
+        for (size_t j = 0; j < DISTANCE_LANES; j++) {
+            dist += partial[j];
+        }
+        if (dist > bound) return dist;
+    }
+    for (; i + DISTANCE_LANES <= d; i += DISTANCE_LANES) {
+        for (size_t j = 0; j < DISTANCE_LANES; j++) {
+            value_t diff = a[i + j] - b[i + j];
+            partial[j] += diff * diff;
+        }
+    }
+    value_t dist = 0;
+    for (size_t j = 0; j < DISTANCE_LANES; j++) {
+        dist += partial[j];
+    }
+    for (; i < d; i++) {
+        value_t diff = a[i] - b[i];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+template <typename value_t>
+void distance_block(const value_t *const *a, size_t num_a, const value_t *const *b, size_t num_b, size_t d, value_t *out, const value_t *bounds = nullptr) {
+    // Compute the num_a x num_b block of distances between rows of a and rows of b, stored row-major in out
+    // Rows of b are visited in tiles so that they stay in cache while every row of a is compared against them
+    // With bounds, distances from row i of a may stop early once they exceed bounds[i]
+    constexpr size_t tile_size = 16;
+    for (size_t tile = 0; tile < num_b; tile += tile_size) {
+        size_t tile_end = tile + tile_size < num_b ? tile + tile_size : num_b;
+        for (size_t i = 0; i < num_a; i++) {
+            for (size_t j = tile; j < tile_end; j++) {
+                out[i * num_b + j] = bounds == nullptr ? squared_distance(a[i], b[j], d) : squared_distance_bounded(a[i], b[j], d, bounds[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,450 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <unordered_set>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+
+#include "point_set.h"
+#include "epoch.h"
+#include "greedy_search.h"
+#include "robust_prune.h"
+#include "navigability.h"
+
+template <typename value_t = float, typename index_t = uint32_t>
+class DynamicNavigableGraph {
+    // Updates are serialized by a writer lock, while searches run concurrently on published adjacency lists
+    // Adjacency lists are replaced instead of modified, and the whole version is replaced when it grows or is compacted
+    // Replaced lists and versions are reclaimed through epochs once no search can still hold them
+    struct version {
+        PointSet<value_t> points; // Sized to capacity, only the first num_points are valid
+        ConcurrentAdjacency<index_t> adjlists;
+        std::vector<std::atomic<bool>> deleted;
+        std::atomic<size_t> num_points;
+        std::atomic<size_t> num_deleted;
+
+        version(size_t capacity, size_t dims, EpochManager &epochs) : points(capacity, dims), adjlists(capacity, epochs), deleted(capacity), num_points(0), num_deleted(0) {}
+
+        size_t capacity() const {
+            return adjlists.capacity();
+        }
+    };
+
+    EpochManager epochs;
+    std::atomic<version *> current;
+    std::mutex write_lock;
+
+    // Hops through deleted vertices that consolidation follows to find live replacements
+    static constexpr size_t RECONNECT_HOPS = 2;
+
+    version *grow(version *v, size_t capacity) {
+        // Copy the valid prefix of a version into a larger one and publish it
+        size_t n = v->num_points.load();
+        version *grown = new version(capacity, v->points.dimension(), epochs);
+        parlay::parallel_for(0, n, [&](size_t i) {
+            grown->points[i] = v->points[i];
+            grown->adjlists.publish(i, std::vector<index_t>(v->adjlists[i]));
+            grown->deleted[i].store(v->deleted[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        });
+        grown->num_deleted.store(v->num_deleted.load());
+        grown->num_points.store(n);
+        current.store(grown);
+        epochs.retire(v);
+        return grown;
+    }
+
+public:
+    class snapshot {
+        // A consistent view for searches, valid while the snapshot is alive
+        // Vertices appended by concurrent inserts may become visible, but ids never change under a snapshot
+        EpochManager::guard guard;
+        version *v;
+
+    public:
+        snapshot(EpochManager::guard &&guard, version *v) : guard(std::move(guard)), v(v) {}
+
+        size_t size() const {
+            return v->num_points.load(std::memory_order_acquire);
+        }
+
+        const std::vector<index_t> &operator[](size_t i) const {
+            return v->adjlists[i];
+        }
+
+        PointSet<value_t> &points() const {
+            return v->points;
+        }
+
+        bool is_deleted(index_t i) const {
+            return v->deleted[i].load(std::memory_order_relaxed);
+        }
+
+        size_t num_deleted() const {
+            return v->num_deleted.load(std::memory_order_relaxed);
+        }
+
+        std::pair<uint32_t, uint32_t> search(uint32_t source, uint32_t query) const {
+            return greedy_search(v->adjlists, v->points, source, query, [&](uint32_t i) {
+                return v->deleted[i].load(std::memory_order_relaxed);
+            });
+        }
+    };
+
+    // Pruning applied to the candidates of newly inserted vertices
+    // The default keeps every candidate needed to cover all targets, so inserted vertices stay navigable
+    Prune::parameters insert_params;
+
+    // Pruning applied to the neighbors of deleted vertices when they replace them during consolidation
+    Prune::parameters consolidate_params;
+
+    // Check the vertices reconnecting rewired against every live target and add an edge for each pair that lost its cover
+    // Pruning the replacements can drop a neighbor that covered some target, so without this a consolidated graph
+    // may stop being navigable. Lists that were not rewired keep their covers, so only the rewired sources are checked
+    bool repair_consolidation = true;
+
+    DynamicNavigableGraph(const PointSet<value_t> &points, const std::vector<std::vector<index_t>> &adjlists, size_t capacity = 0) {
+        // The dimension is taken from the first point, so the graph needs at least one
+        size_t n = points.size();
+        if (n == 0) {
+            std::cerr << "Error: a dynamic graph needs at least one initial point" << std::endl;
+            std::abort();
+        }
+        version *v = new version(std::max(capacity, n), points.dimension(), epochs);
+        parlay::parallel_for(0, n, [&](size_t i) {
+            v->points[i] = points[i];
+            v->adjlists.publish(i, std::vector<index_t>(adjlists[i]));
+        });
+        v->num_points.store(n);
+        current.store(v);
+    }
+
+    ~DynamicNavigableGraph() {
+        delete current.load();
+    }
+
+    snapshot read() {
+        // Enter the epoch before loading the version so that it cannot be reclaimed underneath the reader
+        auto guard = epochs.enter();
+        return snapshot(std::move(guard), current.load());
+    }
+
+    size_t size() {
+        return read().size();
+    }
+
+    double deleted_fraction() {
+        auto s = read();
+        size_t n = s.size();
+        return n == 0 ? 0 : s.num_deleted() / (double)n;
+    }
+
+    size_t pending_reclaim() {
+        return epochs.pending();
+    }
+
+    index_t insert(const PointSet<value_t> &batch) {
+        // Insert a batch of points and return the id of the first one
+        // Only the new vertices get set covers, and existing vertices are only patched for the new targets they fail to cover
+        std::lock_guard<std::mutex> lock(write_lock);
+        version *v = current.load();
+        size_t old_size = v->num_points.load();
+        size_t batch_size = batch.size();
+        if (batch_size == 0) return old_size;
+        size_t new_size = old_size + batch_size;
+        if (new_size > v->capacity()) {
+            v = grow(v, std::max(new_size, 2 * v->capacity()));
+        }
+        auto &points = v->points;
+        auto &adjlists = v->adjlists;
+        auto &deleted = v->deleted;
+
+        // New points are written before any list that refers to them is published
+        parlay::parallel_for(0, batch_size, [&](size_t i) {
+            points[old_size + i] = typename PointSet<value_t>::Point(old_size + i, batch[i].data(), batch[i].size());
+        });
+
+        // Distances from each new point to every point
+        auto rows = parlay::tabulate(batch_size, [&](size_t i) {
+            std::vector<value_t> row(new_size);
+            for (size_t j = 0; j < new_size; j++) {
+                row[j] = points[old_size + i].distance(points[j]);
+            }
+            return row;
+        }, 1);
+
+        // Cover every live target from each new vertex
+        parlay::parallel_for(0, batch_size, [&](size_t i) {
+            index_t x = old_size + i;
+            auto &row = rows[i];
+            std::vector<index_t> candidates;
+            candidates.reserve(new_size - 1);
+            for (size_t j = 0; j < new_size; j++) {
+                if (j != x && !deleted[j].load(std::memory_order_relaxed)) candidates.push_back(j);
+            }
+            std::sort(candidates.begin(), candidates.end(), [&](index_t a, index_t b) {
+                return row[a] < row[b];
+            });
+            size_t num_candidates = std::min(candidates.size(), insert_params.candidate_size);
+            std::vector<value_t> candidate_dists(num_candidates);
+            for (size_t j = 0; j < num_candidates; j++) {
+                candidate_dists[j] = row[candidates[j]];
+            }
+            Prune::point_distances<index_t, PointSet<value_t>> block_distances(points);
+            adjlists.publish(x, Prune::robust_prune(candidates.data(), candidate_dists.data(), num_candidates, insert_params, block_distances));
+        }, 1);
+
+        // Patch existing vertices that have no neighbor closer to a new point than themselves
+        // Deleted vertices are patched too since searches still pass through them
+        // New points are visited nearest first, so a patched edge often covers the points after it
+        parlay::parallel_for(0, old_size, [&](size_t u) {
+            std::vector<index_t> order(batch_size);
+            for (size_t i = 0; i < batch_size; i++) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](index_t a, index_t b) {
+                return rows[a][u] < rows[b][u];
+            });
+            const auto &adjlist = adjlists[u];
+            std::vector<index_t> added;
+            auto covers = [&](index_t s, index_t x, value_t dist) {
+                return points[s].distance(points[x], dist) < dist;
+            };
+            for (index_t i : order) {
+                index_t x = old_size + i;
+                value_t dist = rows[i][u];
+                bool is_covered = std::any_of(adjlist.begin(), adjlist.end(), [&](index_t s) { return covers(s, x, dist); })
+                    || std::any_of(added.begin(), added.end(), [&](index_t s) { return covers(s, x, dist); });
+                if (!is_covered) added.push_back(x);
+            }
+            if (!added.empty()) {
+                std::vector<index_t> patched(adjlist);
+                patched.insert(patched.end(), added.begin(), added.end());
+                adjlists.publish(u, std::move(patched));
+            }
+        }, 1);
+
+        v->num_points.store(new_size, std::memory_order_release);
+        epochs.reclaim();
+        return old_size;
+    }
+
+    navigability_report verify_inserted(index_t first, size_t count, size_t max_violations = -1ULL) {
+        // Check only the pairs an insert can leave uncovered, from the vertices [first, first + count) to every live vertex
+        // and from every live vertex to them, since patching only adds edges and so keeps the covers of all other pairs
+        auto s = read();
+        size_t n = s.size();
+        // Pairs among the inserted vertices are checked with them as sources only
+        std::vector<index_t> inserted, others, all(n);
+        for (size_t i = 0; i < n; i++) {
+            all[i] = i;
+            if (i >= first && i < (size_t)first + count) inserted.push_back(i);
+            else others.push_back(i);
+        }
+        auto is_deleted = [&](size_t i) { return s.is_deleted(i); };
+        auto report = verify_navigability(s, s.points(), inserted, all, max_violations, is_deleted);
+        auto incoming = verify_navigability(s, s.points(), others, inserted, max_violations, is_deleted);
+        report.checked_targets += incoming.checked_targets;
+        report.checked_pairs += incoming.checked_pairs;
+        report.violations = std::min(max_violations, report.violations + incoming.violations);
+        report.complete = report.complete && incoming.complete;
+        report.violating_pairs.insert(report.violating_pairs.end(), incoming.violating_pairs.begin(), incoming.violating_pairs.end());
+        std::sort(report.violating_pairs.begin(), report.violating_pairs.end());
+        return report;
+    }
+
+    void remove(const std::vector<index_t> &ids) {
+        // Mark vertices as deleted, leaving the graph untouched until the next consolidation
+        std::lock_guard<std::mutex> lock(write_lock);
+        version *v = current.load();
+        size_t n = v->num_points.load();
+        for (index_t i : ids) {
+            if (i >= n) {
+                std::cerr << "Error: cannot remove vertex " << i << " from a graph of " << n << " vertices" << std::endl;
+                std::abort();
+            }
+        }
+        for (index_t i : ids) {
+            if (!v->deleted[i].exchange(true)) v->num_deleted++;
+        }
+    }
+
+    void reconnect() {
+        std::lock_guard<std::mutex> lock(write_lock);
+        version *v = current.load();
+        auto rewired = reconnect(v);
+        if (repair_consolidation) repair(v, rewired);
+        epochs.reclaim();
+    }
+
+    std::vector<index_t> consolidate() {
+        // Reconnect around deleted vertices, then publish a compacted version with the live vertices renumbered
+        // Returns the new id of every old id, with deleted ids mapping to -1
+        std::lock_guard<std::mutex> lock(write_lock);
+        version *v = current.load();
+        auto rewired = reconnect(v);
+        if (repair_consolidation) repair(v, rewired);
+        auto new_ids = compact(v);
+        epochs.reclaim();
+        return new_ids;
+    }
+
+    bool maybe_consolidate(double threshold, std::vector<index_t> *new_ids = nullptr) {
+        // Consolidate once the fraction of deleted vertices passes the threshold
+        double fraction = deleted_fraction();
+        if (fraction == 0 || fraction < threshold) return false;
+        auto ids = consolidate();
+        if (new_ids != nullptr) *new_ids = std::move(ids);
+        return true;
+    }
+
+private:
+    std::vector<index_t> reconnect(version *v) {
+        // Replace the deleted out-neighbors of every live vertex with the live vertices reachable through deleted ones,
+        // keeping the surviving neighbors and pruning the replacements against them
+        // Lists of deleted vertices are only read here, so they are never retired while in use
+        // Returns the live vertices whose lists were replaced
+        size_t n = v->num_points.load();
+        auto &points = v->points;
+        auto &adjlists = v->adjlists;
+        auto is_deleted = [&](index_t i) {
+            return v->deleted[i].load(std::memory_order_relaxed);
+        };
+        auto affected = parlay::filter(parlay::iota<index_t>(n), [&](index_t u) {
+            if (is_deleted(u)) return false;
+            const auto &adjlist = adjlists[u];
+            return std::any_of(adjlist.begin(), adjlist.end(), is_deleted);
+        });
+        parlay::parallel_for(0, affected.size(), [&](size_t i) {
+            index_t u = affected[i];
+            const auto &adjlist = adjlists[u];
+
+            std::vector<index_t> kept;
+            std::unordered_set<index_t> seen;
+            seen.insert(u);
+            for (index_t w : adjlist) {
+                if (!is_deleted(w)) {
+                    kept.push_back(w);
+                    seen.insert(w);
+                }
+            }
+            // Chains of deleted vertices are followed for a few hops, so deleted second-hop neighbors are looked through
+            // Longer chains are left to the repair pass, since following them all can reach most of the deleted vertices
+            std::vector<index_t> candidates;
+            std::vector<index_t> frontier, next;
+            for (index_t w : adjlist) {
+                if (is_deleted(w) && seen.insert(w).second) frontier.push_back(w);
+            }
+            for (size_t hop = 0; hop < RECONNECT_HOPS && !frontier.empty(); hop++) {
+                next.clear();
+                for (index_t w : frontier) {
+                    for (index_t x : adjlists[w]) {
+                        if (!seen.insert(x).second) continue;
+                        if (is_deleted(x)) next.push_back(x);
+                        else candidates.push_back(x);
+                    }
+                }
+                std::swap(frontier, next);
+            }
+
+            std::vector<value_t> distances(candidates.size());
+            for (size_t j = 0; j < candidates.size(); j++) {
+                distances[j] = points[u].distance(points[candidates[j]]);
+            }
+            std::vector<index_t> order(candidates.size());
+            for (size_t j = 0; j < order.size(); j++) {
+                order[j] = j;
+            }
+            std::sort(order.begin(), order.end(), [&](index_t a, index_t b) {
+                return distances[a] < distances[b];
+            });
+            std::vector<index_t> sorted_candidates(candidates.size());
+            std::vector<value_t> sorted_distances(candidates.size());
+            for (size_t j = 0; j < order.size(); j++) {
+                sorted_candidates[j] = candidates[order[j]];
+                sorted_distances[j] = distances[order[j]];
+            }
+
+            Prune::point_distances<index_t, PointSet<value_t>> block_distances(points);
+            size_t num_candidates = std::min(sorted_candidates.size(), consolidate_params.candidate_size);
+            adjlists.publish(u, Prune::robust_prune(sorted_candidates.data(), sorted_distances.data(), num_candidates, consolidate_params, block_distances, std::move(kept)));
+        }, 1);
+        return std::vector<index_t>(affected.begin(), affected.end());
+    }
+
+    void repair(version *v, const std::vector<index_t> &sources) {
+        // Give every rewired source that lost its cover of a live target an edge to that target, which covers it
+        // Targets are added nearest first and skipped when an edge added before them already covers them
+        struct live_graph {
+            version *v;
+            size_t size() const { return v->num_points.load(); }
+            const std::vector<index_t> &operator[](size_t i) const { return v->adjlists[i]; }
+        };
+        live_graph graph{v};
+        auto &points = v->points;
+        std::vector<index_t> targets(graph.size());
+        for (size_t i = 0; i < targets.size(); i++) {
+            targets[i] = i;
+        }
+        auto report = verify_navigability(graph, points, sources, targets, -1ULL, [&](size_t i) {
+            return v->deleted[i].load(std::memory_order_relaxed);
+        });
+        auto &pairs = report.violating_pairs;
+        size_t start = 0;
+        while (start < pairs.size()) {
+            size_t end = start;
+            while (end < pairs.size() && pairs[end].first == pairs[start].first) end++;
+            index_t s = pairs[start].first;
+            std::vector<std::pair<value_t, index_t>> lost;
+            for (size_t j = start; j < end; j++) {
+                index_t t = pairs[j].second;
+                lost.push_back({points[s].distance(points[t]), t});
+            }
+            std::sort(lost.begin(), lost.end());
+            std::vector<index_t> patched(v->adjlists[s]);
+            size_t original = patched.size();
+            for (auto [dist, t] : lost) {
+                bool is_covered = std::any_of(patched.begin() + original, patched.end(), [&](index_t x) {
+                    return points[x].distance(points[t], dist) < dist;
+                });
+                if (!is_covered) patched.push_back(t);
+            }
+            v->adjlists.publish(s, std::move(patched));
+            start = end;
+        }
+    }
+
+    std::vector<index_t> compact(version *v) {
+        size_t n = v->num_points.load();
+        std::vector<index_t> new_ids(n);
+        size_t live = 0;
+        for (size_t i = 0; i < n; i++) {
+            new_ids[i] = v->deleted[i].load() ? (index_t)-1 : (index_t)live++;
+        }
+
+        version *compacted = new version(v->capacity(), v->points.dimension(), epochs);
+        parlay::parallel_for(0, n, [&](size_t i) {
+            if (new_ids[i] == (index_t)-1) return;
+            index_t id = new_ids[i];
+            compacted->points[id] = typename PointSet<value_t>::Point(id, v->points[i].data(), v->points[i].size());
+            std::vector<index_t> adjlist;
+            adjlist.reserve(v->adjlists[i].size());
+            for (index_t u : v->adjlists[i]) {
+                if (new_ids[u] != (index_t)-1) adjlist.push_back(new_ids[u]);
+            }
+            compacted->adjlists.publish(id, std::move(adjlist));
+        });
+        compacted->num_points.store(live);
+        current.store(compacted);
+        epochs.retire(v);
+        return new_ids;
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/random.h>
+
+#include "point_set.h"
+#include "distance.h"
+#include "greedy_search.h"
+
+template <typename value_t>
+uint32_t approximate_medoid(PointSet<value_t> &points) {
+    // Return the point closest to the centroid
+    size_t n = points.size();
+    size_t d = points.dimension();
+    std::vector<double> centroid(d, 0);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < d; j++) {
+            centroid[j] += points[i][j];
+        }
+    }
+    std::vector<value_t> center(d);
+    for (size_t j = 0; j < d; j++) {
+        center[j] = centroid[j] / n;
+    }
+
+    auto dists = parlay::tabulate(n, [&](size_t i) {
+        return squared_distance(points[i].data(), center.data(), d);
+    });
+    return parlay::min_element(dists) - dists.begin();
+}
+
+class EntryPoints {
+    // Vertices to start searches from, with the approximate medoid first
+    // Each query starts from the pivot closest to it
+public:
+    std::vector<uint32_t> pivots;
+
+    EntryPoints() {}
+
+    explicit EntryPoints(std::vector<uint32_t> pivots) : pivots(std::move(pivots)) {}
+
+    template <typename value_t>
+    EntryPoints(PointSet<value_t> &points, size_t num_pivots) {
+        // Spread the remaining pivots out from the medoid by farthest-first traversal of a sample of the points
+        size_t n = points.size();
+        pivots.push_back(approximate_medoid(points));
+        num_pivots = std::min(num_pivots, n);
+        if (num_pivots <= 1) return;
+
+        parlay::random_generator gen(0);
+        std::uniform_int_distribution<size_t> dis(0, n - 1);
+        auto sample = parlay::tabulate(std::min(n, 100 * num_pivots), [&](size_t i) {
+            auto rnd = gen[i];
+            return (uint32_t)dis(rnd);
+        });
+        auto nearest = parlay::map(sample, [&](uint32_t i) {
+            return points[i].distance(points[pivots[0]]);
+        });
+        while (pivots.size() < num_pivots) {
+            size_t best = 0;
+            for (size_t i = 1; i < sample.size(); i++) {
+                if (nearest[i] > nearest[best]) best = i;
+            }
+            if (nearest[best] == 0) break;
+            uint32_t pivot = sample[best];
+            pivots.push_back(pivot);
+            parlay::parallel_for(0, sample.size(), [&](size_t i) {
+                nearest[i] = std::min(nearest[i], points[sample[i]].distance(points[pivot]));
+            });
+        }
+    }
+
+    EntryPoints(std::string filename, size_t num_points) {
+        // Reject files that are truncated or refer to points past the end of the dataset, such as those saved for another dataset
+        std::ifstream reader(filename, std::ios::binary);
+        if (!reader.is_open()) {
+            std::cout << "Entry point file " << filename << " not found" << std::endl;
+            std::abort();
+        }
+        uint32_t num_pivots;
+        if (!reader.read((char *)(&num_pivots), sizeof(uint32_t)) || num_pivots == 0) {
+            std::cerr << "Error: entry point file " << filename << " has no pivots" << std::endl;
+            std::abort();
+        }
+        pivots.resize(num_pivots);
+        if (!reader.read((char *)pivots.data(), num_pivots * sizeof(uint32_t))) {
+            std::cerr << "Error: entry point file " << filename << " is truncated" << std::endl;
+            std::abort();
+        }
+        for (uint32_t pivot : pivots) {
+            if (pivot >= num_points) {
+                std::cerr << "Error: entry point " << pivot << " in " << filename << " is outside the " << num_points << " points" << std::endl;
+                std::abort();
+            }
+        }
+    }
+
+    void save(std::string filename) const {
+        // Stored as the number of pivots followed by their ids, all as 32-bit integers
+        std::ofstream writer(filename, std::ios::binary);
+        uint32_t num_pivots = pivots.size();
+        writer.write((char *)(&num_pivots), sizeof(uint32_t));
+        writer.write((char *)pivots.data(), num_pivots * sizeof(uint32_t));
+    }
+
+    size_t size() const {
+        return pivots.size();
+    }
+
+    template <typename value_t>
+    uint32_t nearest(PointSet<value_t> &points, const typename PointSet<value_t>::Point &query) const {
+        uint32_t best = pivots[0];
+        value_t best_dist = std::numeric_limits<value_t>::max();
+        for (uint32_t pivot : pivots) {
+            value_t dist = points[pivot].distance(query, best_dist);
+            if (dist < best_dist) {
+                best = pivot;
+                best_dist = dist;
+            }
+        }
+        return best;
+    }
+};
+
+template <typename Graph, typename value_t>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, const EntryPoints &entry, const typename PointSet<value_t>::Point &query) {
+    // Start from the closest pivot, counting the comparisons spent choosing it
+    uint32_t source = entry.nearest(points, query);
+    auto [result, dist_comps] = greedy_search(graph, points, source, query);
+    return std::make_pair(result, dist_comps + (uint32_t)entry.size() - 1);
+}
+
+template <typename Graph, typename value_t, typename Stats>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, const EntryPoints &entry, const typename PointSet<value_t>::Point &query, Stats &stats) {
+    uint32_t source = entry.nearest(points, query);
+    stats.add_distances(entry.size() - 1);
+    auto [result, dist_comps] = greedy_search(graph, points, source, query, [](uint32_t) { return false; }, stats);
+    return std::make_pair(result, dist_comps + (uint32_t)entry.size() - 1);
+}
+
+template <typename Graph, typename value_t, typename Stats>
+std::pair<uint32_t, uint32_t> parallel_greedy_search(Graph &graph, PointSet<value_t> &points, const EntryPoints &entry, const typename PointSet<value_t>::Point &query,
+                                                     const expansion_parameters &params, Stats &stats) {
+    uint32_t source = entry.nearest(points, query);
+    stats.add_distances(entry.size() - 1);
+    auto [result, dist_comps] = parallel_greedy_search(graph, points, source, query, [](uint32_t) { return false; }, params, stats);
+    return std::make_pair(result, dist_comps + (uint32_t)entry.size() - 1);
+}
+
+template <typename Graph, typename value_t>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, const EntryPoints &entry, uint32_t query) {
+    return greedy_search(graph, points, entry, points[query]);
+}
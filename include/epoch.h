@@ -0,0 +1,193 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class EpochManager {
+    // Readers announce the global epoch they entered in a per-thread slot
+    // Objects retired at epoch e are freed once no reader that entered at or before e is still active
+public:
+    static constexpr size_t MAX_THREADS = 512;
+    static constexpr uint64_t IDLE = -1ULL;
+
+private:
+    struct alignas(64) slot {
+        std::atomic<uint64_t> epoch{IDLE};
+    };
+
+    std::atomic<uint64_t> global_epoch{0};
+    std::unique_ptr<slot[]> slots;
+    std::mutex retired_lock;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+    class slot_registry {
+        // Slot ids of live threads, shared by every manager, with the ids of exited threads reused first
+        std::mutex lock;
+        std::vector<size_t> free_ids;
+        size_t next_id = 0;
+
+    public:
+        size_t acquire() {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!free_ids.empty()) {
+                size_t id = free_ids.back();
+                free_ids.pop_back();
+                return id;
+            }
+            if (next_id >= MAX_THREADS) {
+                std::cerr << "Error: more than " << MAX_THREADS << " live threads entered an epoch" << std::endl;
+                std::abort();
+            }
+            return next_id++;
+        }
+
+        void release(size_t id) {
+            std::lock_guard<std::mutex> guard(lock);
+            free_ids.push_back(id);
+        }
+    };
+
+    static slot_registry &registry() {
+        static slot_registry slots;
+        return slots;
+    }
+
+    struct slot_owner {
+        // Holds a slot id for the lifetime of its thread
+        // Guards never outlive the thread that created them, so the slot is idle in every manager once it is released
+        size_t id;
+        slot_owner() : id(registry().acquire()) {}
+        ~slot_owner() { registry().release(id); }
+    };
+
+    static size_t thread_slot() {
+        thread_local slot_owner owner;
+        return owner.id;
+    }
+
+public:
+    class guard {
+        slot *s;
+
+    public:
+        guard(slot *s) : s(s) {}
+        guard(guard &&other) : s(other.s) { other.s = nullptr; }
+        guard(const guard &) = delete;
+        guard &operator=(const guard &) = delete;
+        ~guard() {
+            if (s != nullptr) s->epoch.store(IDLE, std::memory_order_release);
+        }
+    };
+
+    EpochManager() : slots(new slot[MAX_THREADS]) {}
+
+    ~EpochManager() {
+        for (auto &[epoch, deleter] : retired) {
+            deleter();
+        }
+    }
+
+    guard enter() {
+        // Nested guards on the same thread keep the epoch of the outermost one
+        slot &s = slots[thread_slot()];
+        if (s.epoch.load(std::memory_order_relaxed) != IDLE) return guard(nullptr);
+        s.epoch.store(global_epoch.load(), std::memory_order_relaxed);
+        // Order the announcement before any pointer the reader loads inside the epoch
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return guard(&s);
+    }
+
+    void retire(std::function<void()> deleter) {
+        // The caller must have unlinked the object so that readers entering from now on cannot reach it
+        std::lock_guard<std::mutex> lock(retired_lock);
+        retired.emplace_back(global_epoch.fetch_add(1), std::move(deleter));
+    }
+
+    template <typename T>
+    void retire(const T *ptr) {
+        retire([ptr]() { delete ptr; });
+    }
+
+    size_t reclaim() {
+        // Free every retired object that no active reader can still hold, returning how many were freed
+        uint64_t min_active = IDLE;
+        for (size_t i = 0; i < MAX_THREADS; i++) {
+            min_active = std::min(min_active, slots[i].epoch.load());
+        }
+
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(retired_lock);
+            size_t kept = 0;
+            for (size_t i = 0; i < retired.size(); i++) {
+                if (retired[i].first < min_active) ready.push_back(std::move(retired[i].second));
+                else retired[kept++] = std::move(retired[i]);
+            }
+            retired.resize(kept);
+        }
+        for (auto &deleter : ready) {
+            deleter();
+        }
+        return ready.size();
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(retired_lock);
+        return retired.size();
+    }
+};
+
+template <typename index_t = uint32_t>
+class ConcurrentAdjacency {
+    // Fixed-capacity adjacency lists that are replaced rather than modified
+    // Readers must stay inside an epoch of the manager while they hold a list
+    using list_t = std::vector<index_t>;
+
+    size_t _capacity;
+    std::unique_ptr<std::atomic<const list_t *>[]> lists;
+    EpochManager &epochs;
+
+    static const list_t *empty_list() {
+        static const list_t empty;
+        return &empty;
+    }
+
+public:
+    ConcurrentAdjacency(size_t capacity, EpochManager &epochs) : _capacity(capacity), lists(new std::atomic<const list_t *>[capacity]), epochs(epochs) {
+        for (size_t i = 0; i < _capacity; i++) {
+            lists[i].store(empty_list(), std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentAdjacency(const ConcurrentAdjacency &) = delete;
+    ConcurrentAdjacency &operator=(const ConcurrentAdjacency &) = delete;
+
+    ~ConcurrentAdjacency() {
+        for (size_t i = 0; i < _capacity; i++) {
+            const list_t *list = lists[i].load(std::memory_order_relaxed);
+            if (list != empty_list()) delete list;
+        }
+    }
+
+    inline size_t capacity() const {
+        return _capacity;
+    }
+
+    inline const list_t &operator[](size_t i) const {
+        return *lists[i].load(std::memory_order_acquire);
+    }
+
+    void publish(size_t i, list_t &&list) {
+        // Swap in a new list for vertex i and retire the old one once readers are done with it
+        const list_t *old = lists[i].exchange(new list_t(std::move(list)), std::memory_order_acq_rel);
+        if (old != empty_list()) epochs.retire(old);
+    }
+};
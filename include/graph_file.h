@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <parlay/parallel.h>
+
+#include <utils/graph.h>
+
+template <typename index_t = uint32_t>
+std::vector<std::vector<index_t>> load_adjlists(const std::string &filename) {
+    // Read a graph in the ParlayANN format into plain adjacency lists
+    parlayANN::Graph<index_t> graph(filename.data());
+    std::vector<std::vector<index_t>> adjlists(graph.size());
+    parlay::parallel_for(0, graph.size(), [&](size_t i) {
+        adjlists[i].reserve(graph[i].size());
+        for (size_t j = 0; j < graph[i].size(); j++) {
+            adjlists[i].push_back(graph[i][j]);
+        }
+    });
+    return adjlists;
+}
@@ -1,38 +1,219 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <vector>
 #include <utility>
 
 #include <parlay/sequence.h>
+#include <parlay/primitives.h>
 
 #include "point_set.h"
+#include "stats.h"
 
-template <typename Graph, typename value_t>
-std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, uint32_t query) {
+template <typename Graph, typename value_t, typename Deleted, typename Stats>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query, const Deleted &is_deleted, Stats &stats) {
+    // Deleted vertices are traversed like any other vertex but never returned
+    // The result is the closest live vertex evaluated along the path
+    // A neighbor only matters if it is closer than the best live vertex so far, so its distance stops early past that
     parlay::sequence<bool> visited(points.size(), false);
     uint32_t current = source;
-    value_t current_dist = points[source].distance(points[query]);
+    value_t current_dist = points[source].distance(query);
     uint32_t dist_comps = 1;
+    stats.distance();
+    uint32_t best = source;
+    value_t best_dist = current_dist;
+    bool found = !is_deleted(source);
 
     while (!visited[current]) {
         visited[current] = true;
+        stats.hop();
+        stats.visit();
         for (uint32_t neighbor : graph[current]) {
             if (visited[neighbor]) continue;
-            value_t dist = points[neighbor].distance(points[query]);
+            value_t dist = points[neighbor].distance(query, found ? best_dist : std::numeric_limits<value_t>::max());
             dist_comps++;
+            stats.distance();
+            bool live = !is_deleted(neighbor);
+            if (live && (!found || dist < best_dist)) {
+                best = neighbor;
+                best_dist = dist;
+                found = true;
+            }
             if (dist < current_dist) {
-                if (dist == 0) {
+                if (dist == 0 && live) {
                     return std::make_pair(neighbor, dist_comps);
                 }
-                visited[current] = true;
                 current = neighbor;
                 current_dist = dist;
             }
             else {
                 visited[neighbor] = true;
+                stats.visit();
+            }
+        }
+    }
+    return std::make_pair(found ? best : current, dist_comps);
+}
+
+template <typename Graph, typename value_t, typename Deleted>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query, const Deleted &is_deleted) {
+    NoSearchStats stats;
+    return greedy_search(graph, points, source, query, is_deleted, stats);
+}
+
+template <typename Graph, typename value_t, typename Deleted>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, uint32_t query, const Deleted &is_deleted) {
+    return greedy_search(graph, points, source, points[query], is_deleted);
+}
+
+template <typename Graph, typename value_t>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query) {
+    return greedy_search(graph, points, source, query, [](uint32_t) { return false; });
+}
+
+template <typename Graph, typename value_t>
+std::pair<uint32_t, uint32_t> greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, uint32_t query) {
+    return greedy_search(graph, points, source, points[query], [](uint32_t) { return false; });
+}
+
+struct expansion_parameters {
+    size_t min_degree = 512; // Adjacency lists shorter than this are scanned serially
+    size_t max_workers = 4;  // Parts a longer list is split into, each scanned by one worker
+};
+
+// Neighbors whose distances are computed together by distance_block
+constexpr size_t EXPANSION_BATCH = 16;
+
+template <typename value_t>
+struct expansion_result {
+    // Closest neighbors found by one part of a scan, where ties go to the earlier position in the list
+    size_t position = -1ULL;
+    value_t dist = std::numeric_limits<value_t>::max();
+    size_t live_position = -1ULL;
+    value_t live_dist = std::numeric_limits<value_t>::max();
+    uint32_t dist_comps = 0;
+
+    void merge(const expansion_result &other) {
+        if (other.dist < dist || (other.dist == dist && other.position < position)) {
+            position = other.position;
+            dist = other.dist;
+        }
+        if (other.live_dist < live_dist || (other.live_dist == live_dist && other.live_position < live_position)) {
+            live_position = other.live_position;
+            live_dist = other.live_dist;
+        }
+        dist_comps += other.dist_comps;
+    }
+};
+
+template <typename List, typename value_t, typename Deleted>
+expansion_result<value_t> expand_range(const List &list, size_t start, size_t end, PointSet<value_t> &points, const typename PointSet<value_t>::Point &query,
+                                       const Deleted &is_deleted, std::vector<std::atomic<bool>> &visited, value_t bound) {
+    // Distances from the query to the unvisited neighbors in list[start, end), computed in batches
+    // Each neighbor is claimed with a test-and-set as its distance is computed, so the caller needs no pass over the list
+    // afterwards, and a neighbor listed twice, even in parts scanned by different workers, is computed once
+    // The bound tightens between batches as closer live neighbors are found
+    expansion_result<value_t> result;
+    const value_t *rows[EXPANSION_BATCH];
+    size_t positions[EXPANSION_BATCH];
+    value_t dists[EXPANSION_BATCH];
+    const value_t *query_row = query.data();
+    for (size_t j = start; j < end;) {
+        size_t num_rows = 0;
+        for (; j < end && num_rows < EXPANSION_BATCH; j++) {
+            auto &flag = visited[list[j]];
+            if (flag.load(std::memory_order_relaxed) || flag.exchange(true, std::memory_order_relaxed)) continue;
+            rows[num_rows] = points[list[j]].data();
+            positions[num_rows++] = j;
+        }
+        distance_block(&query_row, 1, rows, num_rows, points.dimension(), dists, &bound);
+        for (size_t b = 0; b < num_rows; b++) {
+            expansion_result<value_t> single;
+            single.position = positions[b];
+            single.dist = dists[b];
+            if (!is_deleted(list[positions[b]])) {
+                single.live_position = positions[b];
+                single.live_dist = dists[b];
+                bound = std::min(bound, dists[b]);
+            }
+            single.dist_comps = 1;
+            result.merge(single);
+        }
+    }
+    return result;
+}
+
+template <typename Graph, typename value_t, typename Deleted, typename Stats>
+std::pair<uint32_t, uint32_t> parallel_greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query,
+                                                     const Deleted &is_deleted, const expansion_parameters &params, Stats &stats) {
+    // Greedy search for latency rather than throughput, returning the same vertex as greedy_search
+    // Each hop moves to the closest unvisited neighbor, which is what the serial scan ends on as well
+    // Long adjacency lists are split into parts scanned by different workers and merged with a min-reduction,
+    // so a query crossing a hub is not bounded by one worker scanning thousands of neighbors
+    // Every scanned neighbor is marked visited, including the one moved to, which skips some distances greedy_search would recompute
+    std::vector<std::atomic<bool>> visited(points.size());
+    uint32_t current = source;
+    value_t current_dist = points[source].distance(query);
+    uint32_t dist_comps = 1;
+    stats.distance();
+    uint32_t best = source;
+    value_t best_dist = current_dist;
+    bool found = !is_deleted(source);
+    visited[source].store(true, std::memory_order_relaxed);
+    stats.visit();
+
+    // Each hop moves strictly closer to the query, so the search ends
+    while (true) {
+        stats.hop();
+        auto &&list = graph[current];
+        size_t degree = list.size();
+        value_t bound = found ? best_dist : std::numeric_limits<value_t>::max();
+        expansion_result<value_t> scan;
+        if (degree < params.min_degree || params.max_workers <= 1) {
+            scan = expand_range(list, 0, degree, points, query, is_deleted, visited, bound);
+        }
+        else {
+            // Parts are at least a batch long, so short lists are not split into parts with nothing to compute
+            size_t num_parts = std::min(params.max_workers, (degree + EXPANSION_BATCH - 1) / EXPANSION_BATCH);
+            auto parts = parlay::tabulate(num_parts, [&](size_t p) {
+                return expand_range(list, p * degree / num_parts, (p + 1) * degree / num_parts, points, query, is_deleted, visited, bound);
+            }, 1);
+            for (auto &part : parts) {
+                scan.merge(part);
             }
         }
+
+        // Every distance computed was to a neighbor the scan marked visited
+        dist_comps += scan.dist_comps;
+        stats.add_distances(scan.dist_comps);
+        stats.add_visits(scan.dist_comps);
+        if (scan.live_position != -1ULL && (!found || scan.live_dist < best_dist)) {
+            best = list[scan.live_position];
+            best_dist = scan.live_dist;
+            found = true;
+            if (best_dist == 0) {
+                return std::make_pair(best, dist_comps);
+            }
+        }
+        if (scan.position == -1ULL || !(scan.dist < current_dist)) break;
+        current = list[scan.position];
+        current_dist = scan.dist;
     }
-    return std::make_pair(current, dist_comps);
-}
\ No newline at end of file
+    return std::make_pair(found ? best : current, dist_comps);
+}
+
+template <typename Graph, typename value_t, typename Deleted>
+std::pair<uint32_t, uint32_t> parallel_greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query,
+                                                     const Deleted &is_deleted, const expansion_parameters &params) {
+    NoSearchStats stats;
+    return parallel_greedy_search(graph, points, source, query, is_deleted, params, stats);
+}
+
+template <typename Graph, typename value_t>
+std::pair<uint32_t, uint32_t> parallel_greedy_search(Graph &graph, PointSet<value_t> &points, uint32_t source, const typename PointSet<value_t>::Point &query,
+                                                     const expansion_parameters &params) {
+    return parallel_greedy_search(graph, points, source, query, [](uint32_t) { return false; }, params);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+
+#include "point_set.h"
+#include "distance.h"
+
+// Number of queries whose nearest neighbors are collected together while a tile of base points is in cache
+constexpr size_t GROUND_TRUTH_QUERY_BATCH = 32;
+// Number of base points compared against each batch of queries at a time
+constexpr size_t GROUND_TRUTH_TILE_SIZE = 512;
+
+template <typename value_t = float>
+class GroundTruth {
+    // The exact k nearest base points of every query, sorted by distance with ties broken by id
+    // Stored in the .gt format: the number of queries and k as 32-bit integers, then all ids, then all distances
+    size_t _size, _k;
+    std::vector<uint32_t> ids;
+    std::vector<value_t> dists;
+
+public:
+    GroundTruth() : _size(0), _k(0) {}
+
+    GroundTruth(PointSet<value_t> &points, PointSet<value_t> &queries, size_t k)
+        : _size(queries.size()), _k(std::min(k, points.size())), ids(_size * _k), dists(_size * _k) {
+        // Each batch of queries streams the base points in tiles, keeping a bounded max-heap per query
+        // A distance stops early once it exceeds the farthest neighbor kept so far, since it can no longer enter the heap
+        size_t n = points.size();
+        size_t d = points.dimension();
+        size_t num_batches = (_size + GROUND_TRUTH_QUERY_BATCH - 1) / GROUND_TRUTH_QUERY_BATCH;
+        parlay::parallel_for(0, num_batches, [&](size_t batch) {
+            size_t start = batch * GROUND_TRUTH_QUERY_BATCH;
+            size_t end = std::min(start + GROUND_TRUTH_QUERY_BATCH, _size);
+            size_t batch_size = end - start;
+            std::vector<const value_t *> query_rows(batch_size), tile_rows(GROUND_TRUTH_TILE_SIZE);
+            for (size_t i = 0; i < batch_size; i++) {
+                query_rows[i] = queries[start + i].data();
+            }
+            std::vector<std::vector<std::pair<value_t, uint32_t>>> heaps(batch_size);
+            for (auto &heap : heaps) {
+                heap.reserve(_k + 1);
+            }
+            std::vector<value_t> bounds(batch_size, std::numeric_limits<value_t>::max());
+            std::vector<value_t> block(batch_size * GROUND_TRUTH_TILE_SIZE);
+
+            for (size_t tile = 0; tile < n && _k > 0; tile += GROUND_TRUTH_TILE_SIZE) {
+                size_t tile_size = std::min(GROUND_TRUTH_TILE_SIZE, n - tile);
+                for (size_t j = 0; j < tile_size; j++) {
+                    tile_rows[j] = points[tile + j].data();
+                }
+                distance_block(query_rows.data(), batch_size, tile_rows.data(), tile_size, d, block.data(), bounds.data());
+                for (size_t i = 0; i < batch_size; i++) {
+                    auto &heap = heaps[i];
+                    for (size_t j = 0; j < tile_size; j++) {
+                        std::pair<value_t, uint32_t> entry(block[i * tile_size + j], tile + j);
+                        if (heap.size() == _k && !(entry < heap.front())) continue;
+                        heap.push_back(entry);
+                        std::push_heap(heap.begin(), heap.end());
+                        if (heap.size() > _k) {
+                            std::pop_heap(heap.begin(), heap.end());
+                            heap.pop_back();
+                        }
+                    }
+                    if (heap.size() == _k) bounds[i] = heap.front().first;
+                }
+            }
+
+            for (size_t i = 0; i < batch_size; i++) {
+                std::sort_heap(heaps[i].begin(), heaps[i].end());
+                for (size_t j = 0; j < _k; j++) {
+                    ids[(start + i) * _k + j] = heaps[i][j].second;
+                    dists[(start + i) * _k + j] = heaps[i][j].first;
+                }
+            }
+        }, 1);
+    }
+
+    explicit GroundTruth(std::string filename) {
+        std::ifstream reader(filename, std::ios::binary);
+        if (!reader.is_open()) {
+            std::cout << "Ground truth file " << filename << " not found" << std::endl;
+            std::abort();
+        }
+        uint32_t n, k;
+        reader.read((char *)(&n), sizeof(uint32_t));
+        reader.read((char *)(&k), sizeof(uint32_t));
+        _size = n;
+        _k = k;
+        ids.resize(_size * _k);
+        dists.resize(_size * _k);
+        reader.read((char *)ids.data(), ids.size() * sizeof(uint32_t));
+        reader.read((char *)dists.data(), dists.size() * sizeof(value_t));
+    }
+
+    void save(std::string filename) const {
+        std::ofstream writer(filename, std::ios::binary);
+        uint32_t n = _size, k = _k;
+        writer.write((char *)(&n), sizeof(uint32_t));
+        writer.write((char *)(&k), sizeof(uint32_t));
+        writer.write((char *)ids.data(), ids.size() * sizeof(uint32_t));
+        writer.write((char *)dists.data(), dists.size() * sizeof(value_t));
+    }
+
+    size_t size() const {
+        return _size;
+    }
+    size_t k() const {
+        return _k;
+    }
+    uint32_t id(size_t i, size_t j) const {
+        return ids[i * _k + j];
+    }
+    value_t distance(size_t i, size_t j) const {
+        return dists[i * _k + j];
+    }
+};
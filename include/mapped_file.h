@@ -0,0 +1,51 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class MappedFile {
+    // A whole file mapped copy-on-write, so the mapping can be written to without changing the file
+    // Pages are read in lazily by the kernel on first access
+    char *_data = nullptr;
+    size_t _size = 0;
+
+public:
+    explicit MappedFile(std::string filename) {
+        int fd = open(filename.data(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error: could not open " << filename << std::endl;
+            std::abort();
+        }
+        struct stat info;
+        fstat(fd, &info);
+        _size = info.st_size;
+        void *mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Error: could not map " << filename << std::endl;
+            std::abort();
+        }
+        _data = (char *)mapping;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (_data != nullptr) munmap(_data, _size);
+    }
+
+    char *data() const {
+        return _data;
+    }
+    size_t size() const {
+        return _size;
+    }
+};
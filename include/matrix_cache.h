@@ -0,0 +1,177 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <parlay/sequence.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "mapped_file.h"
+#include "mng_utils.h"
+#include "numa.h"
+
+// Bumped whenever the layout of a cached matrix or its header changes, invalidating existing caches
+constexpr uint32_t MATRIX_CACHE_VERSION = 1;
+constexpr uint64_t MATRIX_CACHE_MAGIC = 0x4d4e474d41545258ULL;
+// The header is padded to a page so the matrix itself is page aligned in the mapping
+constexpr size_t MATRIX_CACHE_HEADER_SIZE = 4096;
+
+struct matrix_cache_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t element_size;
+    uint64_t num_points;
+    uint64_t dims;
+    uint64_t content_hash;
+    double build_time; // Seconds the matrix took to build, which every later load saves
+};
+
+struct matrix_cache_report {
+    size_t hits = 0;         // Matrices mapped from the cache
+    size_t misses = 0;       // Matrices built and written to the cache
+    double load_time = 0;    // Seconds spent mapping cached matrices
+    double build_time = 0;   // Seconds spent building and writing missing matrices
+    double saved_time = 0;   // Recorded build times of the mapped matrices minus the time to map them
+};
+
+template <typename value_t>
+uint64_t content_hash(PointSet<value_t> &points) {
+    // FNV-1a over the coordinates of each point, combined in order
+    auto hashes = parlay::tabulate(points.size(), [&](size_t i) {
+        uint64_t hash = 14695981039346656037ULL;
+        const unsigned char *bytes = (const unsigned char *)points[i].data();
+        for (size_t j = 0; j < points.dimension() * sizeof(value_t); j++) {
+            hash = (hash ^ bytes[j]) * 1099511628211ULL;
+        }
+        return hash;
+    });
+    uint64_t hash = points.size();
+    for (uint64_t h : hashes) {
+        hash = (hash ^ h) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename index_t, typename value_t>
+class MatrixCache {
+    // Distance, permutation, and rank matrices of a dataset kept as files named after the dataset's full path and its size
+    // A file is only used when its version, sizes, and content hash match the points, and is rebuilt otherwise
+    std::string prefix;
+    size_t n, d;
+    uint64_t hash;
+    NumaPolicy policy; // Placement of matrices built on a miss, while mapped matrices live in the page cache
+
+    std::string path(std::string kind) const {
+        return prefix + "." + kind;
+    }
+
+    std::shared_ptr<MappedFile> find(std::string kind, size_t element_size, double &build_time) const {
+        std::ifstream reader(path(kind), std::ios::binary);
+        if (!reader.is_open()) return nullptr;
+        matrix_cache_header header;
+        reader.read((char *)(&header), sizeof(header));
+        if (!reader || header.magic != MATRIX_CACHE_MAGIC || header.version != MATRIX_CACHE_VERSION || header.element_size != element_size
+            || header.num_points != n || header.dims != d || header.content_hash != hash) {
+            return nullptr;
+        }
+        reader.seekg(0, std::ios::end);
+        if ((size_t)reader.tellg() != MATRIX_CACHE_HEADER_SIZE + n * n * element_size) return nullptr;
+        build_time = header.build_time;
+        return std::make_shared<MappedFile>(path(kind));
+    }
+
+    void write(std::string kind, const void *data, size_t element_size, double build_time) const {
+        // Write to a temporary file and rename it, so an interrupted write never looks like a valid cache
+        matrix_cache_header header = {MATRIX_CACHE_MAGIC, MATRIX_CACHE_VERSION, (uint32_t)element_size, n, d, hash, build_time};
+        std::vector<char> padded(MATRIX_CACHE_HEADER_SIZE, 0);
+        std::memcpy(padded.data(), &header, sizeof(header));
+        // The temporary name is unique to this process and call, so concurrent writers never share a file
+        std::string temp = path(kind) + ".tmp." + std::to_string(getpid()) + ".XXXXXX";
+        int fd = mkstemp(temp.data());
+        if (fd < 0) {
+            std::cerr << "Warning: could not write matrix cache " << path(kind) << std::endl;
+            return;
+        }
+        fchmod(fd, 0644);
+        close(fd);
+        std::ofstream writer(temp, std::ios::binary | std::ios::trunc);
+        writer.write(padded.data(), padded.size());
+        writer.write((const char *)data, n * n * element_size);
+        writer.close();
+        if (!writer || std::rename(temp.data(), path(kind).data()) != 0) {
+            std::cerr << "Warning: could not write matrix cache " << path(kind) << std::endl;
+            std::remove(temp.data());
+        }
+    }
+
+    template <typename Matrix, typename Build>
+    Matrix load_or_build(std::string kind, size_t element_size, Build build) {
+        parlay::internal::timer timer;
+        timer.start();
+        double recorded_time;
+        if (auto mapping = find(kind, element_size, recorded_time)) {
+            Matrix matrix(n, mapping, MATRIX_CACHE_HEADER_SIZE);
+            double load_time = timer.next_time();
+            report.hits++;
+            report.load_time += load_time;
+            report.saved_time += recorded_time - load_time;
+            return matrix;
+        }
+        Matrix matrix = build();
+        double build_time = timer.next_time();
+        write(kind, matrix.data(), element_size, build_time);
+        report.misses++;
+        report.build_time += timer.next_time() + build_time;
+        return matrix;
+    }
+
+public:
+    matrix_cache_report report;
+
+    MatrixCache(std::string directory, std::string dataset, PointSet<value_t> &points, NumaPolicy policy = NumaPolicy::first_touch)
+        : n(points.size()), d(points.dimension()), hash(content_hash(points)), policy(policy) {
+        // Datasets with the same file name in different directories get different entries,
+        // keyed by a hash of the absolute path next to the readable base name
+        std::filesystem::create_directories(directory);
+        std::string full_path = std::filesystem::absolute(dataset).lexically_normal().string();
+        uint64_t path_hash = 14695981039346656037ULL;
+        for (unsigned char c : full_path) {
+            path_hash = (path_hash ^ c) * 1099511628211ULL;
+        }
+        char path_key[17];
+        std::snprintf(path_key, sizeof(path_key), "%016llx", (unsigned long long)path_hash);
+        std::string name = std::filesystem::path(dataset).stem().string();
+        prefix = directory + "/" + name + "_" + path_key + "_" + std::to_string(n);
+    }
+
+    DistanceMatrix<value_t> distances(PointSet<value_t> &points) {
+        return load_or_build<DistanceMatrix<value_t>>("dist", sizeof(value_t), [&]() {
+            return DistanceMatrix<value_t>(points, policy);
+        });
+    }
+
+    PermutationMatrix<index_t> permutations(DistanceMatrix<value_t> &distances) {
+        return load_or_build<PermutationMatrix<index_t>>("perm", sizeof(index_t), [&]() {
+            return PermutationMatrix<index_t>(distances, policy);
+        });
+    }
+
+    RankMatrix<index_t> ranks(DistanceMatrix<value_t> &distances, PermutationMatrix<index_t> &permutations) {
+        return load_or_build<RankMatrix<index_t>>("rank", sizeof(index_t), [&]() {
+            return RankMatrix<index_t>(distances, permutations, policy);
+        });
+    }
+};
@@ -6,7 +6,9 @@
 #include <cmath>
 #include <utility>
 #include <vector>
+#include <algorithm>
 #include <unordered_set>
+#include <unordered_map>
 #include <atomic>
 #include <mutex>
 
@@ -18,27 +20,30 @@
 
 #include "point_set.h"
 #include "mng_utils.h"
+#include "nn_descent.h"
+#include "numa.h"
+#include "stats.h"
+#include "navigability.h"
 
 namespace MNG {
-    template <typename index_t>
-    inline bool covers(index_t i, index_t s, index_t p, const RankMatrix<index_t> &ranks) {
+    template <typename index_t, typename Ranks>
+    inline bool covers(index_t i, index_t s, index_t p, const Ranks &ranks) {
         // Check if set s covers point p in set cover instance i
         return ranks[p][s] < ranks[p][i];
     }
-    template <typename index_t>
-    inline auto sets_of(index_t i, index_t p, const PermutationMatrix<index_t> &permutations, const RankMatrix<index_t> &ranks) {
+    template <typename index_t, typename Permutations, typename Ranks>
+    inline auto sets_of(index_t i, index_t p, const Permutations &permutations, const Ranks &ranks) {
         // Get the sets that cover point p in set cover instance i
         return parlay::make_slice(permutations[p], permutations[p] + ranks[p][i]);
     }
 
-    template <typename index_t>
-    void minimum_adjacency_list(size_t n, index_t i, std::vector<index_t> &uncovered, std::vector<index_t> &adjlist, const PermutationMatrix<index_t> &permutations, const RankMatrix<index_t> &ranks) {
+    template <typename index_t, typename Permutations, typename Ranks>
+    void minimum_adjacency_list(size_t n, index_t i, std::vector<index_t> &uncovered, std::vector<index_t> &adjlist, const Permutations &permutations, const Ranks &ranks, set_cover_counts &counts) {
         // Initialize voter data structures
+        // Only sets that cover some sampled point receive votes, so voters are kept per voted-for set
         size_t logn = std::ceil(std::log2(n));
-        std::vector<std::unordered_set<index_t>> voters(n);
-        for (size_t j = 0; j < voters.size(); j++) {
-            voters[j].reserve(logn);
-        }
+        std::unordered_map<index_t, std::unordered_set<index_t>> voters;
+        voters.reserve(uncovered.size());
         UnorderedQueue<index_t> all_voters;
 
         // Sample uncovered points to obtain high-contribution sets
@@ -63,23 +68,28 @@ namespace MNG {
                 if (voters[s].size() >= logn - 1) {
                     // If the set has enough votes, add it to the adjacency list and remove its voters
                     adjlist.push_back(s);
+                    counts.sets_chosen++;
                     all_voters.pop_back();
                     for (; j > 0; j--) {
-                        voters[sets[j - 1]].erase(p);
+                        counts.voters_erased += voters[sets[j - 1]].erase(p);
                     }
                     for (index_t v : voters[s]) {
                         auto v_sets = sets_of(i, v, permutations, ranks);
                         for (index_t v_s : v_sets) {
-                            if (v_s != s) {
-                                voters[v_s].erase(v);
-                            }
+                            if (v_s == s) continue;
+                            auto it = voters.find(v_s);
+                            if (it != voters.end()) counts.voters_erased += it->second.erase(v);
                         }
                         all_voters.erase(v);
                     }
-                    voters[s].clear();
+                    counts.voters_erased += voters[s].size();
+                    voters.erase(s);
                     break;
                 }
-                else voters[s].insert(p);
+                else {
+                    voters[s].insert(p);
+                    counts.votes_cast++;
+                }
             }
         }
 
@@ -87,14 +97,17 @@ namespace MNG {
         while (!all_voters.empty()) {
             index_t s = all_voters.pop_back();
             adjlist.push_back(s);
-            for (auto v : voters[s]) {
+            counts.sets_chosen++;
+            auto it = voters.find(s);
+            if (it == voters.end()) continue;
+            for (auto v : it->second) {
                 all_voters.erase(v);
             }
         }
     }
 
-    template <typename index_t>
-    std::pair<bool, std::vector<std::vector<index_t>>> minimum_navigable_graph_opt(size_t num_points, size_t opt_deg, const PermutationMatrix<index_t> &permutations, const RankMatrix<index_t> &ranks) {
+    template <typename index_t, typename Permutations, typename Ranks, typename Stats>
+    std::pair<bool, std::vector<std::vector<index_t>>> minimum_navigable_graph_opt(size_t num_points, size_t opt_deg, const Permutations &permutations, const Ranks &ranks, NumaPolicy policy, Stats &stats) {
         std::vector<std::vector<index_t>> adjlists(num_points);
         size_t est_avg_deg = opt_deg * std::ceil(std::log2(num_points)); // Assuming num_points > 1
         size_t est_tot_deg = 2 * est_avg_deg * num_points;
@@ -116,11 +129,13 @@ namespace MNG {
         }, 1);
 
         // Initialize sets of uncovered points
+        // Truncated permutations only know the ranks of their leading entries, which bounds the instances they feed
         std::vector<std::vector<index_t>> uncovered(num_points);
         std::vector<std::mutex> locks(num_points);
         size_t uncovered_per_instance = num_points / opt_deg;
         parlay::parallel_for(0, num_points, [&](size_t i) {
-            for (size_t j = 1; j < uncovered_per_instance; j++) {
+            size_t end = std::min(uncovered_per_instance, permutations.row_size(i));
+            for (size_t j = 1; j < end; j++) {
                 index_t p = permutations[i][j];
                 std::lock_guard<std::mutex> lock(locks[p]);
                 uncovered[p].push_back(i);
@@ -128,39 +143,263 @@ namespace MNG {
         }, 1);
 
         // Compute adjacency lists using set cover
+        // With rows placement, blocks of instances run on the node holding their rows of the matrices
         std::atomic<size_t> tot_deg = 0;
         size_t block_size = num_points / 2 / parlay::num_workers();
         if (block_size < 1) block_size = 1;
-        size_t num_blocks = (num_points + block_size - 1) / block_size;
-        parlay::parallel_for(0, num_blocks, [&](size_t b) {
-            size_t start = b * block_size;
-            size_t end = std::min(start + block_size, num_points);
-            for (index_t i = start; i < end; i++) {
-                if (tot_deg > est_tot_deg) break;
-                auto rnd = gen[i];
-                std::shuffle(uncovered[i].begin(), uncovered[i].end(), rnd);
-                minimum_adjacency_list<index_t>(num_points, i, uncovered[i], adjlists[i], permutations, ranks);
-                tot_deg += adjlists[i].size();
-            }
-        }, 1);
+        numa_parallel_for(0, num_points, block_size, policy, [&](size_t i) {
+            if (tot_deg > est_tot_deg) return;
+            auto rnd = gen[i];
+            std::shuffle(uncovered[i].begin(), uncovered[i].end(), rnd);
+            set_cover_counts counts;
+            minimum_adjacency_list<index_t>(num_points, (index_t)i, uncovered[i], adjlists[i], permutations, ranks, counts);
+            stats.add(counts);
+            tot_deg += adjlists[i].size();
+        });
 
         if (tot_deg > est_tot_deg) return {false, {}};
         return {true, adjlists};
     }
 
-    template <typename index_t, typename value_t, typename PointSet>
-    std::vector<std::vector<index_t>> minimum_navigable_graph(PointSet &points) {
-        // Compute the distance, permutation, and rank matrices
-        DistanceMatrix<value_t> distances(points);
-        PermutationMatrix<index_t> permutations(distances);
-        RankMatrix<index_t> ranks(distances, permutations);
-
+    template <typename index_t, typename Permutations, typename Ranks, typename Stats>
+    std::vector<std::vector<index_t>> minimum_navigable_graph(size_t num_points, const Permutations &permutations, const Ranks &ranks, NumaPolicy policy, Stats &stats) {
         // Exponential search for the optimal number of edges
         size_t avg_deg = 1;
         while (true) {
-            auto [success, adjlists] = minimum_navigable_graph_opt<index_t>(points.size(), avg_deg, permutations, ranks);
+            stats.attempt();
+            auto [success, adjlists] = minimum_navigable_graph_opt<index_t>(num_points, avg_deg, permutations, ranks, policy, stats);
             if (success) return adjlists;
             avg_deg *= 2;
         }
     }
+
+    template <typename index_t, typename Permutations, typename Ranks>
+    std::vector<std::vector<index_t>> minimum_navigable_graph(size_t num_points, const Permutations &permutations, const Ranks &ranks, NumaPolicy policy = NumaPolicy::first_touch) {
+        NoBuildStats stats;
+        return minimum_navigable_graph<index_t>(num_points, permutations, ranks, policy, stats);
+    }
+
+    template <typename index_t, typename value_t, typename PointSet>
+    std::vector<std::vector<index_t>> minimum_navigable_graph(PointSet &points, NumaPolicy policy = NumaPolicy::first_touch) {
+        // Compute the distance, permutation, and rank matrices
+        DistanceMatrix<value_t> distances(points, policy);
+        PermutationMatrix<index_t> permutations(distances, policy);
+        RankMatrix<index_t> ranks(distances, permutations, policy);
+
+        return minimum_navigable_graph<index_t>(points.size(), permutations, ranks, policy);
+    }
+
+    template <typename index_t, typename value_t, typename PointSet, typename Stats>
+    std::vector<std::vector<index_t>> minimum_navigable_graph(PointSet &points, const std::vector<std::vector<index_t>> &neighbors, Stats &stats) {
+        // Build the set cover instances from approximate nearest neighbor lists instead of all-pairs ranks
+        // Targets of instance i are the points listing i as a neighbor, so memory and time scale with the list lengths
+        TruncatedPermutations<index_t> permutations(points, neighbors);
+        TruncatedRanks<index_t> ranks(points, permutations);
+
+        return minimum_navigable_graph<index_t>(points.size(), permutations, ranks, NumaPolicy::first_touch, stats);
+    }
+
+    template <typename index_t, typename value_t, typename PointSet>
+    std::vector<std::vector<index_t>> minimum_navigable_graph(PointSet &points, const std::vector<std::vector<index_t>> &neighbors) {
+        NoBuildStats stats;
+        return minimum_navigable_graph<index_t, value_t>(points, neighbors, stats);
+    }
+
+    template <typename index_t, typename value_t, typename PointSet>
+    std::vector<std::vector<index_t>> approximate_navigable_graph(PointSet &points, const NNDescent::parameters &params = NNDescent::parameters(), bool verbose = false) {
+        auto neighbors = NNDescent::knn_graph<index_t>(points, params, verbose);
+        return minimum_navigable_graph<index_t, value_t>(points, neighbors);
+    }
+
+    struct bound_report {
+        size_t unbounded_max_deg = 0;
+        double unbounded_avg_deg = 0;
+        size_t bounded_max_deg = 0;
+        double bounded_avg_deg = 0;
+        size_t overflow_vertices = 0;   // Vertices whose adjacency lists exceeded the bound
+        size_t removed_edges = 0;       // Edges dropped from overflowing adjacency lists
+        size_t redistributed_edges = 0; // Dropped edges re-added to a kept neighbor of their source
+        size_t uncovered_pairs = 0;     // Pairs (v, t) where v no longer has a neighbor closer to t
+        size_t recovered_edges = 0;     // Edges outside the unbounded list chosen to cover targets the cut lost
+        bool navigable = true;          // False if some overflowing vertex could not cover all its targets within the bound
+    };
+
+    // Candidates closer to a lost target than its source, taken from the front of the target's permutation row, in each widening round
+    constexpr size_t RECOVER_CANDIDATES[] = {8, 64};
+    // Widening adds at most this many candidates per vertex, since each one costs a pass over all n targets
+    constexpr size_t MAX_RECOVER_CANDIDATES = 256;
+
+    template <typename index_t, typename Permutations>
+    std::vector<index_t> bounded_cover(size_t n, index_t v, const std::vector<index_t> &adjlist, size_t max_degree, const Permutations &permutations, const RankMatrix<index_t> &ranks, size_t &uncovered, size_t &recovered) {
+        // Choose at most max_degree neighbors of v covering as many targets t != v as possible, greedily by coverage
+        // Candidates start as the unbounded adjacency list, and whenever targets are left uncovered the candidates are
+        // widened with points closer to each of those targets than v is, then the greedy cover is recomputed
+        // Targets at distance zero from v cannot be covered and need no cover, since a search from v already sits on them
+        size_t words = (n + 63) / 64;
+        std::vector<uint64_t> targets(words, 0);
+        for (size_t t = 0; t < n; t++) {
+            if (t != v && ranks[t][v] > 0) targets[t / 64] |= 1ULL << (t % 64);
+        }
+
+        std::vector<index_t> candidates;
+        std::unordered_set<index_t> in_candidates;
+        std::vector<std::vector<uint64_t>> cover;
+        auto add_candidate = [&](index_t c) {
+            if (c == v || !in_candidates.insert(c).second) return;
+            candidates.push_back(c);
+            cover.emplace_back(words, 0);
+            for (size_t t = 0; t < n; t++) {
+                if ((targets[t / 64] >> (t % 64) & 1) && covers<index_t>(v, c, (index_t)t, ranks)) {
+                    cover.back()[t / 64] |= 1ULL << (t % 64);
+                }
+            }
+        };
+        for (index_t u : adjlist) {
+            add_candidate(u);
+        }
+        size_t original = candidates.size();
+        size_t limit = original + MAX_RECOVER_CANDIDATES;
+
+        std::vector<index_t> subset;
+        std::vector<uint64_t> covered(words);
+        auto greedy = [&]() {
+            std::fill(covered.begin(), covered.end(), 0);
+            std::vector<bool> chosen(candidates.size(), false);
+            subset.clear();
+            uncovered = 0;
+            while (subset.size() < max_degree) {
+                size_t best = candidates.size(), best_gain = 0;
+                for (size_t j = 0; j < candidates.size(); j++) {
+                    if (chosen[j]) continue;
+                    size_t gain = 0;
+                    for (size_t w = 0; w < words; w++) {
+                        gain += __builtin_popcountll(cover[j][w] & ~covered[w]);
+                    }
+                    if (gain > best_gain) {
+                        best = j;
+                        best_gain = gain;
+                    }
+                }
+                if (best == candidates.size()) break;
+                chosen[best] = true;
+                subset.push_back(best);
+                for (size_t w = 0; w < words; w++) {
+                    covered[w] |= cover[best][w];
+                }
+            }
+            for (size_t w = 0; w < words; w++) {
+                uncovered += __builtin_popcountll(targets[w] & ~covered[w]);
+            }
+        };
+
+        greedy();
+        for (size_t widen : RECOVER_CANDIDATES) {
+            if (uncovered == 0 || candidates.size() >= limit) break;
+            for (size_t w = 0; w < words && candidates.size() < limit; w++) {
+                uint64_t lost = targets[w] & ~covered[w];
+                while (lost && candidates.size() < limit) {
+                    size_t t = w * 64 + __builtin_ctzll(lost);
+                    lost &= lost - 1;
+                    size_t closer = std::min<size_t>(ranks[t][v], widen);
+                    for (size_t j = 0; j < closer && candidates.size() < limit; j++) {
+                        add_candidate(permutations[t][j]);
+                    }
+                }
+            }
+            greedy();
+        }
+
+        std::vector<index_t> neighbors;
+        neighbors.reserve(subset.size());
+        recovered = 0;
+        for (size_t j : subset) {
+            neighbors.push_back(candidates[j]);
+            if (j >= original) recovered++;
+        }
+        return neighbors;
+    }
+
+    template <typename index_t, typename Permutations>
+    bound_report bound_degree(std::vector<std::vector<index_t>> &adjlists, size_t max_degree, const Permutations &permutations, const RankMatrix<index_t> &ranks) {
+        // Cut every adjacency list down to max_degree edges while keeping every vertex navigable when possible
+        // Overflowing lists are replaced by a bounded greedy cover of all their targets, which may use edges outside the
+        // unbounded list. Pairs no bounded cover was found for are counted in uncovered_pairs and clear navigable, since the
+        // minimum cover of a vertex can need more than max_degree sets and the greedy cover is not always minimum
+        // Each dropped edge (v, u) is also re-added to the kept neighbor of v closest to u if it has room, shortening paths to u
+        size_t num_points = adjlists.size();
+        bound_report report;
+        auto degrees = parlay::map(adjlists, [](auto &adjlist) { return adjlist.size(); });
+        report.unbounded_max_deg = parlay::reduce(degrees, parlay::maxm<size_t>());
+        report.unbounded_avg_deg = parlay::reduce(degrees) / (double)num_points;
+
+        auto overflow = parlay::filter(parlay::iota<index_t>(num_points), [&](index_t v) {
+            return adjlists[v].size() > max_degree;
+        });
+        report.overflow_vertices = overflow.size();
+
+        // Choose the kept edges of each overflowing vertex
+        std::vector<std::vector<index_t>> removed(num_points);
+        std::atomic<size_t> uncovered_pairs = 0, recovered_edges = 0;
+        parlay::parallel_for(0, overflow.size(), [&](size_t i) {
+            index_t v = overflow[i];
+            size_t uncovered, recovered;
+            auto kept = bounded_cover<index_t>(num_points, v, adjlists[v], max_degree, permutations, ranks, uncovered, recovered);
+            std::unordered_set<index_t> kept_set(kept.begin(), kept.end());
+            for (index_t u : adjlists[v]) {
+                if (kept_set.find(u) == kept_set.end()) removed[v].push_back(u);
+            }
+            adjlists[v] = std::move(kept);
+            uncovered_pairs += uncovered;
+            recovered_edges += recovered;
+        }, 1);
+        report.uncovered_pairs = uncovered_pairs;
+        report.recovered_edges = recovered_edges;
+        report.navigable = report.uncovered_pairs == 0;
+
+        // Redistribute dropped edges to the kept neighbor closest to their target
+        // A kept list can be shorter than max_degree and so receive edges itself, so targets are chosen from a snapshot
+        auto kept_lists = parlay::map(overflow, [&](index_t v) { return adjlists[v]; });
+        std::vector<std::mutex> locks(num_points);
+        std::atomic<size_t> removed_edges = 0, redistributed_edges = 0;
+        parlay::parallel_for(0, overflow.size(), [&](size_t i) {
+            index_t v = overflow[i];
+            const auto &kept = kept_lists[i];
+            removed_edges += removed[v].size();
+            if (kept.empty()) return;
+            for (index_t u : removed[v]) {
+                index_t w = kept[0];
+                for (index_t x : kept) {
+                    if (ranks[u][x] < ranks[u][w]) w = x;
+                }
+                std::lock_guard<std::mutex> lock(locks[w]);
+                auto &adjlist = adjlists[w];
+                if (adjlist.size() >= max_degree) continue;
+                if (std::find(adjlist.begin(), adjlist.end(), u) != adjlist.end()) continue;
+                adjlist.push_back(u);
+                redistributed_edges++;
+            }
+        }, 1);
+        report.removed_edges = removed_edges;
+        report.redistributed_edges = redistributed_edges;
+
+        degrees = parlay::map(adjlists, [](auto &adjlist) { return adjlist.size(); });
+        report.bounded_max_deg = parlay::reduce(degrees, parlay::maxm<size_t>());
+        report.bounded_avg_deg = parlay::reduce(degrees) / (double)num_points;
+        return report;
+    }
+
+    template <typename index_t, typename value_t, typename PointSet>
+    std::vector<std::vector<index_t>> bounded_navigable_graph(PointSet &points, size_t max_degree, bound_report *report = nullptr) {
+        // Build the minimum navigable graph and then enforce a hard maximum degree
+        DistanceMatrix<value_t> distances(points);
+        PermutationMatrix<index_t> permutations(distances);
+        RankMatrix<index_t> ranks(distances, permutations);
+
+        auto adjlists = minimum_navigable_graph<index_t>(points.size(), permutations, ranks);
+        auto result = bound_degree<index_t>(adjlists, max_degree, permutations, ranks);
+        // Confirm the result on the points themselves, failing when some pair lost its cover under the bound
+        result.navigable = verify_navigability(adjlists, points, 1).violations == 0;
+        if (report != nullptr) *report = result;
+        return adjlists;
+    }
 };
\ No newline at end of file
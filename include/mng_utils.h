@@ -2,43 +2,61 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <utility>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 #include <parlay/sequence.h>
 #include <parlay/parallel.h>
+#include <parlay/primitives.h>
 
 #include "point_set.h"
+#include "mapped_file.h"
+#include "numa.h"
 
 template <typename value_t>
 class DistanceMatrix {
     size_t _size;
     parlay::sequence<value_t> dists;
+    std::shared_ptr<MappedFile> mapping; // Backs the matrix instead of dists when it was loaded from a cache
+    value_t *mapped = nullptr;
 
 public:
     template <typename Points>
-    DistanceMatrix(Points &points) : _size(points.size()) {
+    DistanceMatrix(Points &points, NumaPolicy policy = NumaPolicy::first_touch) : _size(points.size()) {
         dists = parlay::sequence<value_t>::uninitialized(_size * _size);
+        numa_place(dists.begin(), _size, _size * sizeof(value_t), policy);
         auto &matrix = *this;
-        parlay::parallel_for(0, _size, [&](size_t i) {
+        numa_parallel_for(0, _size, 1, policy, [&](size_t i) {
             matrix[i][i] = 0;
             for (size_t j = i + 1; j < _size; j++) {
                 value_t dist = points[i].distance(points[j]);
                 matrix[i][j] = dist;
                 matrix[j][i] = dist;
             }
-        }, 1);
+        });
     }
 
+    DistanceMatrix(size_t size, std::shared_ptr<MappedFile> mapping, size_t offset)
+        : _size(size), mapping(std::move(mapping)), mapped((value_t *)(this->mapping->data() + offset)) {}
+
     inline size_t size() const {
         return _size;
     }
 
+    inline value_t *data() {
+        return mapped != nullptr ? mapped : dists.begin();
+    }
+    inline const value_t *data() const {
+        return mapped != nullptr ? mapped : dists.begin();
+    }
+
     inline value_t *operator[](size_t i) {
-        return dists.begin() + i * _size;
+        return data() + i * _size;
     }
     inline const value_t *operator[](size_t i) const {
-        return dists.begin() + i * _size;
+        return data() + i * _size;
     }
 };
 
@@ -46,34 +64,49 @@ template <typename index_t = uint32_t>
 class PermutationMatrix {
     size_t _size;
     parlay::sequence<index_t> indices;
+    std::shared_ptr<MappedFile> mapping; // Backs the matrix instead of indices when it was loaded from a cache
+    index_t *mapped = nullptr;
 
 public:
     template <typename value_t>
-    PermutationMatrix(DistanceMatrix<value_t> &dist_mat) : _size(dist_mat.size()) {
+    PermutationMatrix(DistanceMatrix<value_t> &dist_mat, NumaPolicy policy = NumaPolicy::first_touch) : _size(dist_mat.size()) {
         indices = parlay::sequence<uint32_t>::uninitialized(_size * _size);
+        numa_place(indices.begin(), _size, _size * sizeof(index_t), policy);
         auto &matrix = *this;
-        parlay::parallel_for(0, _size, [&](size_t i) {
+        numa_parallel_for(0, _size, 1, policy, [&](size_t i) {
             for (size_t j = 0; j < _size; j++) {
                 matrix[i][j] = j;
             }
-        }, 1);
-        parlay::parallel_for(0, _size, [&](size_t i) {
             value_t *distances = dist_mat[i];
             std::sort(matrix[i], matrix[i + 1], [&](uint32_t a, uint32_t b) {
                 return distances[a] < distances[b];
             });
-        }, 1);
+        });
     }
 
+    PermutationMatrix(size_t size, std::shared_ptr<MappedFile> mapping, size_t offset)
+        : _size(size), mapping(std::move(mapping)), mapped((index_t *)(this->mapping->data() + offset)) {}
+
     inline size_t size() const {
         return _size;
     }
+    inline size_t row_size(size_t) const {
+        // Every row holds all points, unlike the rows of TruncatedPermutations
+        return _size;
+    }
+
+    inline index_t *data() {
+        return mapped != nullptr ? mapped : indices.begin();
+    }
+    inline const index_t *data() const {
+        return mapped != nullptr ? mapped : indices.begin();
+    }
 
     inline index_t *operator[](size_t i) {
-        return indices.begin() + i * _size;
+        return data() + i * _size;
     }
     inline const index_t *operator[](size_t i) const {
-        return indices.begin() + i * _size;
+        return data() + i * _size;
     }
 };
 
@@ -81,13 +114,16 @@ template <typename index_t = uint32_t>
 class RankMatrix {
     size_t _size;
     parlay::sequence<index_t> ranks;
+    std::shared_ptr<MappedFile> mapping; // Backs the matrix instead of ranks when it was loaded from a cache
+    index_t *mapped = nullptr;
 
 public:
     template <typename value_t>
-    RankMatrix(DistanceMatrix<value_t> &dist_mat, PermutationMatrix<index_t> &perm_mat) : _size(dist_mat.size()) {
+    RankMatrix(DistanceMatrix<value_t> &dist_mat, PermutationMatrix<index_t> &perm_mat, NumaPolicy policy = NumaPolicy::first_touch) : _size(dist_mat.size()) {
         ranks = parlay::sequence<uint32_t>::uninitialized(_size * _size);
+        numa_place(ranks.begin(), _size, _size * sizeof(index_t), policy);
         auto &matrix = *this;
-        parlay::parallel_for(0, _size, [&](size_t i) {
+        numa_parallel_for(0, _size, 1, policy, [&](size_t i) {
             uint32_t *indices = perm_mat[i];
             for (size_t j = 0; j < _size; j++) {
                 matrix[i][indices[j]] = j;
@@ -97,18 +133,129 @@ public:
                     matrix[i][j] = matrix[i][j - 1];
                 }
             }
-        }, 1);
+        });
     }
 
+    RankMatrix(size_t size, std::shared_ptr<MappedFile> mapping, size_t offset)
+        : _size(size), mapping(std::move(mapping)), mapped((index_t *)(this->mapping->data() + offset)) {}
+
     inline size_t size() const {
         return _size;
     }
 
+    inline index_t *data() {
+        return mapped != nullptr ? mapped : ranks.begin();
+    }
+    inline const index_t *data() const {
+        return mapped != nullptr ? mapped : ranks.begin();
+    }
+
     inline index_t *operator[](size_t i) {
-        return ranks.begin() + i * _size;
+        return data() + i * _size;
+    }
+    inline const index_t *operator[](size_t i) const {
+        return data() + i * _size;
+    }
+};
+
+template <typename index_t = uint32_t>
+class TruncatedPermutations {
+    // Leading entries of each row of the permutation matrix, taken from approximate k-nearest neighbor lists
+    // Row i starts with i itself followed by its distinct neighbors in order of distance
+    size_t _size;
+    parlay::sequence<size_t> offsets;
+    parlay::sequence<index_t> indices;
+
+public:
+    template <typename Points>
+    TruncatedPermutations(Points &points, const std::vector<std::vector<index_t>> &neighbors) : _size(points.size()) {
+        using value_t = decltype(points[0].distance(points[0]));
+        auto rows = parlay::tabulate(_size, [&](size_t i) {
+            std::vector<index_t> ids(neighbors[i].begin(), neighbors[i].end());
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            std::vector<std::pair<value_t, index_t>> row;
+            row.reserve(ids.size() + 1);
+            row.push_back({0, (index_t)i});
+            for (index_t j : ids) {
+                if (j != i) row.push_back({points[i].distance(points[j]), j});
+            }
+            std::sort(row.begin() + 1, row.end());
+            return row;
+        }, 1);
+        auto [starts, total] = parlay::scan(parlay::map(rows, [](auto &row) { return row.size(); }));
+        offsets = std::move(starts);
+        offsets.push_back(total);
+        indices = parlay::sequence<index_t>::uninitialized(total);
+        parlay::parallel_for(0, _size, [&](size_t i) {
+            for (size_t j = 0; j < rows[i].size(); j++) {
+                indices[offsets[i] + j] = rows[i][j].second;
+            }
+        });
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+    inline size_t row_size(size_t i) const {
+        return offsets[i + 1] - offsets[i];
     }
+
     inline const index_t *operator[](size_t i) const {
-        return ranks.begin() + i * _size;
+        return indices.begin() + offsets[i];
+    }
+};
+
+template <typename index_t = uint32_t>
+class TruncatedRanks {
+    // Ranks within the truncated permutations, looked up on demand by binary search over each row sorted by id
+    // Points missing from the row of p rank after every point in it
+    size_t _size;
+    parlay::sequence<size_t> offsets;
+    parlay::sequence<std::pair<index_t, index_t>> ranks;
+
+public:
+    class row {
+        const std::pair<index_t, index_t> *begin, *end;
+
+    public:
+        row(const std::pair<index_t, index_t> *begin, const std::pair<index_t, index_t> *end) : begin(begin), end(end) {}
+
+        inline index_t operator[](index_t j) const {
+            auto it = std::lower_bound(begin, end, std::make_pair(j, (index_t)0));
+            if (it != end && it->first == j) return it->second;
+            return end - begin;
+        }
+    };
+
+    template <typename Points>
+    TruncatedRanks(Points &points, const TruncatedPermutations<index_t> &perm) : _size(perm.size()) {
+        using value_t = decltype(points[0].distance(points[0]));
+        auto [starts, total] = parlay::scan(parlay::tabulate(_size, [&](size_t i) { return perm.row_size(i); }));
+        offsets = std::move(starts);
+        offsets.push_back(total);
+        ranks = parlay::sequence<std::pair<index_t, index_t>>::uninitialized(total);
+        parlay::parallel_for(0, _size, [&](size_t i) {
+            const index_t *indices = perm[i];
+            auto *matrix_row = ranks.begin() + offsets[i];
+            // Points at equal distance share a rank
+            value_t prev = 0;
+            for (size_t j = 0; j < perm.row_size(i); j++) {
+                value_t dist = points[i].distance(points[indices[j]]);
+                index_t rank = (j > 0 && dist == prev) ? matrix_row[j - 1].second : j;
+                matrix_row[j] = {indices[j], rank};
+                prev = dist;
+            }
+            std::sort(matrix_row, matrix_row + perm.row_size(i));
+        }, 1);
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+
+    inline row operator[](size_t i) const {
+        return row(ranks.begin() + offsets[i], ranks.begin() + offsets[i + 1]);
     }
 };
 
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+
+#include "point_set.h"
+#include "distance.h"
+
+struct navigability_report {
+    size_t checked_targets = 0;
+    size_t checked_pairs = 0;
+    size_t violations = 0;
+    bool complete = true; // False if the check stopped early after max_violations violations
+    std::vector<std::pair<size_t, size_t>> violating_pairs; // Pairs (s, t) where s has no neighbor strictly closer to t
+};
+
+// Number of distance floats held for a block of targets, which caps the targets checked at once
+constexpr size_t NAVIGABILITY_BLOCK_FLOATS = 1 << 24;
+constexpr size_t NAVIGABILITY_MAX_TARGETS = 64;
+
+template <typename Graph, typename value_t, typename Deleted>
+navigability_report verify_navigability(Graph &graph, PointSet<value_t> &points, size_t max_violations, const Deleted &is_deleted) {
+    // Check that every live s != t has a live neighbor strictly closer to t than s is
+    // Targets are processed in blocks: the distances from every point to the block are computed once,
+    // then each source compares its own column against the minimum over its neighbors' columns
+    // Pairs at distance zero count as navigable since a search from s already sits on t
+    size_t n = graph.size();
+    size_t d = points.dimension();
+    size_t block_size = std::max<size_t>(1, std::min(NAVIGABILITY_MAX_TARGETS, NAVIGABILITY_BLOCK_FLOATS / std::max<size_t>(n, 1)));
+    constexpr size_t chunk_size = 16;
+
+    navigability_report report;
+    std::mutex report_lock;
+    std::atomic<size_t> violations = 0;
+    parlay::sequence<value_t> dists = parlay::sequence<value_t>::uninitialized(n * block_size);
+    std::vector<const value_t *> targets;
+    std::vector<size_t> target_ids;
+
+    for (size_t start = 0; start < n; start += block_size) {
+        if (violations >= max_violations) break;
+        size_t end = std::min(start + block_size, n);
+        targets.clear();
+        target_ids.clear();
+        for (size_t t = start; t < end; t++) {
+            if (is_deleted(t)) continue;
+            targets.push_back(points[t].data());
+            target_ids.push_back(t);
+        }
+        size_t num_targets = targets.size();
+        if (num_targets == 0) continue;
+
+        // Distances from every point to the live targets of the block, one row per point
+        parlay::parallel_for(0, (n + chunk_size - 1) / chunk_size, [&](size_t c) {
+            size_t chunk_start = c * chunk_size;
+            size_t chunk_end = std::min(chunk_start + chunk_size, n);
+            const value_t *sources[chunk_size];
+            for (size_t s = chunk_start; s < chunk_end; s++) {
+                sources[s - chunk_start] = points[s].data();
+            }
+            distance_block(sources, chunk_end - chunk_start, targets.data(), num_targets, d, dists.begin() + chunk_start * num_targets);
+        });
+
+        std::atomic<size_t> pairs = 0;
+        parlay::parallel_for(0, n, [&](size_t s) {
+            if (violations >= max_violations || is_deleted(s)) return;
+            value_t best[NAVIGABILITY_MAX_TARGETS];
+            std::fill(best, best + num_targets, std::numeric_limits<value_t>::max());
+            for (auto u : graph[s]) {
+                if (is_deleted(u)) continue;
+                const value_t *row = dists.begin() + (size_t)u * num_targets;
+                for (size_t j = 0; j < num_targets; j++) {
+                    best[j] = std::min(best[j], row[j]);
+                }
+            }
+
+            const value_t *row = dists.begin() + s * num_targets;
+            size_t checked = 0;
+            for (size_t j = 0; j < num_targets; j++) {
+                if (target_ids[j] == s) continue;
+                checked++;
+                if (row[j] == 0 || best[j] < row[j]) continue;
+                if (violations++ >= max_violations) {
+                    checked--;
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(report_lock);
+                report.violating_pairs.push_back({s, target_ids[j]});
+            }
+            pairs += checked;
+        });
+        report.checked_targets += num_targets;
+        report.checked_pairs += pairs;
+    }
+
+    size_t live = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!is_deleted(i)) live++;
+    }
+    report.violations = std::min<size_t>(violations, max_violations);
+    report.complete = report.checked_pairs == live * (live - 1) || live == 0;
+    std::sort(report.violating_pairs.begin(), report.violating_pairs.end());
+    return report;
+}
+
+template <typename Graph, typename value_t>
+navigability_report verify_navigability(Graph &graph, PointSet<value_t> &points, size_t max_violations = -1ULL) {
+    return verify_navigability(graph, points, max_violations, [](size_t) { return false; });
+}
+
+template <typename Graph, typename value_t, typename Ids, typename Deleted>
+navigability_report verify_navigability(Graph &graph, PointSet<value_t> &points, const Ids &sources, const Ids &targets, size_t max_violations, const Deleted &is_deleted) {
+    // Check only the pairs from the given sources to the given targets, for graphs where an update touched a few vertices
+    // Distances are computed only from the sources and their live neighbors, so the cost follows the touched vertices
+    // rather than n, and the result matches the all-pairs check restricted to these pairs
+    size_t n = graph.size();
+    size_t d = points.dimension();
+    constexpr size_t chunk_size = 16;
+
+    // Rows of the distance block: every live source followed by its live neighbors, each point once
+    std::vector<size_t> row_of(n, -1ULL);
+    std::vector<size_t> row_ids;
+    std::vector<size_t> live_sources;
+    for (size_t s : sources) {
+        if (is_deleted(s) || row_of[s] != -1ULL) continue;
+        live_sources.push_back(s);
+        row_of[s] = row_ids.size();
+        row_ids.push_back(s);
+    }
+    for (size_t s : live_sources) {
+        for (auto u : graph[s]) {
+            if (is_deleted(u) || row_of[u] != -1ULL) continue;
+            row_of[u] = row_ids.size();
+            row_ids.push_back(u);
+        }
+    }
+    std::vector<size_t> live_targets;
+    for (size_t t : targets) {
+        if (!is_deleted(t)) live_targets.push_back(t);
+    }
+    std::sort(live_targets.begin(), live_targets.end());
+    live_targets.erase(std::unique(live_targets.begin(), live_targets.end()), live_targets.end());
+
+    size_t num_rows = row_ids.size();
+    size_t block_size = std::max<size_t>(1, std::min(NAVIGABILITY_MAX_TARGETS, NAVIGABILITY_BLOCK_FLOATS / std::max<size_t>(num_rows, 1)));
+    navigability_report report;
+    std::mutex report_lock;
+    std::atomic<size_t> violations = 0;
+    parlay::sequence<value_t> dists = parlay::sequence<value_t>::uninitialized(num_rows * block_size);
+    std::vector<const value_t *> target_rows;
+
+    for (size_t start = 0; start < live_targets.size(); start += block_size) {
+        if (violations >= max_violations) break;
+        size_t end = std::min(start + block_size, live_targets.size());
+        size_t num_targets = end - start;
+        const size_t *target_ids = live_targets.data() + start;
+        target_rows.clear();
+        for (size_t j = 0; j < num_targets; j++) {
+            target_rows.push_back(points[target_ids[j]].data());
+        }
+
+        parlay::parallel_for(0, (num_rows + chunk_size - 1) / chunk_size, [&](size_t c) {
+            size_t chunk_start = c * chunk_size;
+            size_t chunk_end = std::min(chunk_start + chunk_size, num_rows);
+            const value_t *rows[chunk_size];
+            for (size_t r = chunk_start; r < chunk_end; r++) {
+                rows[r - chunk_start] = points[row_ids[r]].data();
+            }
+            distance_block(rows, chunk_end - chunk_start, target_rows.data(), num_targets, d, dists.begin() + chunk_start * num_targets);
+        });
+
+        std::atomic<size_t> pairs = 0;
+        parlay::parallel_for(0, live_sources.size(), [&](size_t i) {
+            if (violations >= max_violations) return;
+            size_t s = live_sources[i];
+            value_t best[NAVIGABILITY_MAX_TARGETS];
+            std::fill(best, best + num_targets, std::numeric_limits<value_t>::max());
+            for (auto u : graph[s]) {
+                if (is_deleted(u)) continue;
+                const value_t *row = dists.begin() + row_of[u] * num_targets;
+                for (size_t j = 0; j < num_targets; j++) {
+                    best[j] = std::min(best[j], row[j]);
+                }
+            }
+
+            const value_t *row = dists.begin() + row_of[s] * num_targets;
+            size_t checked = 0;
+            for (size_t j = 0; j < num_targets; j++) {
+                if (target_ids[j] == s) continue;
+                checked++;
+                if (row[j] == 0 || best[j] < row[j]) continue;
+                if (violations++ >= max_violations) {
+                    checked--;
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(report_lock);
+                report.violating_pairs.push_back({s, target_ids[j]});
+            }
+            pairs += checked;
+        });
+        report.checked_targets += num_targets;
+        report.checked_pairs += pairs;
+    }
+
+    // Every live source is checked against every live target other than itself
+    size_t expected = 0;
+    for (size_t s : live_sources) {
+        expected += live_targets.size() - std::binary_search(live_targets.begin(), live_targets.end(), s);
+    }
+    report.violations = std::min<size_t>(violations, max_violations);
+    report.complete = report.checked_pairs == expected;
+    std::sort(report.violating_pairs.begin(), report.violating_pairs.end());
+    return report;
+}
+
+template <typename Graph, typename value_t, typename Ids>
+navigability_report verify_navigability(Graph &graph, PointSet<value_t> &points, const Ids &sources, const Ids &targets, size_t max_violations = -1ULL) {
+    return verify_navigability(graph, points, sources, targets, max_violations, [](size_t) { return false; });
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/random.h>
+
+namespace NNDescent {
+    struct parameters {
+        size_t k;              // Number of neighbors kept per point
+        size_t max_candidates; // Number of new and old neighbors sampled per point in each local join
+        size_t max_iters;      // Maximum number of refinement rounds
+        double delta;          // Stop once a round improves fewer than delta * n * k entries
+
+        parameters() : k(32), max_candidates(32), max_iters(10), delta(0.001) {}
+    };
+
+    template <typename index_t, typename value_t>
+    struct neighbor {
+        value_t dist;
+        index_t id;
+        bool is_new;
+
+        bool operator<(const neighbor &other) const {
+            return dist < other.dist || (dist == other.dist && id < other.id);
+        }
+    };
+
+    template <typename index_t, typename value_t>
+    bool try_insert(std::vector<neighbor<index_t, value_t>> &list, size_t k, index_t id, value_t dist) {
+        // Insert id into a sorted list of at most k neighbors, returning true if the list changed
+        if (list.size() >= k && !(neighbor<index_t, value_t>{dist, id, true} < list.back())) return false;
+        for (auto &entry : list) {
+            if (entry.id == id) return false;
+        }
+        neighbor<index_t, value_t> entry{dist, id, true};
+        list.insert(std::upper_bound(list.begin(), list.end(), entry), entry);
+        if (list.size() > k) list.pop_back();
+        return true;
+    }
+
+    template <typename index_t, typename PointSet>
+    std::vector<std::vector<index_t>> knn_graph(PointSet &points, const parameters &params = parameters(), bool verbose = false) {
+        // Approximate the k nearest neighbors of every point by repeatedly joining the neighbors of neighbors
+        // Returns each point's neighbors in order of distance
+        using value_t = decltype(points[0].distance(points[0]));
+        using neighbor_t = neighbor<index_t, value_t>;
+        size_t n = points.size();
+        size_t k = std::min(params.k, n - 1);
+        std::vector<std::vector<neighbor_t>> lists(n);
+        std::vector<std::mutex> locks(n);
+
+        // Start from random neighbors
+        parlay::random_generator gen(0);
+        std::uniform_int_distribution<index_t> dis(0, n - 2);
+        parlay::parallel_for(0, n, [&](size_t i) {
+            auto rnd = gen[i];
+            lists[i].reserve(k + 1);
+            while (lists[i].size() < k) {
+                index_t j = dis(rnd);
+                if (j >= i) j++;
+                try_insert<index_t, value_t>(lists[i], k, j, points[i].distance(points[j]));
+            }
+        });
+
+        for (size_t iter = 0; iter < params.max_iters; iter++) {
+            // Sample new and old neighbors, marking sampled new neighbors as old for the next round
+            std::vector<std::vector<index_t>> new_lists(n), old_lists(n);
+            parlay::parallel_for(0, n, [&](size_t i) {
+                for (auto &entry : lists[i]) {
+                    if (entry.is_new && new_lists[i].size() < params.max_candidates) {
+                        new_lists[i].push_back(entry.id);
+                        entry.is_new = false;
+                    }
+                    else if (!entry.is_new && old_lists[i].size() < params.max_candidates) {
+                        old_lists[i].push_back(entry.id);
+                    }
+                }
+            });
+
+            // Add reverse neighbors, keeping a bounded random sample of them
+            std::vector<std::vector<index_t>> new_reverse(n), old_reverse(n);
+            auto iter_gen = gen[iter + 1];
+            parlay::parallel_for(0, n, [&](size_t i) {
+                auto rnd = iter_gen[i];
+                std::uniform_int_distribution<size_t> slot(0, params.max_candidates - 1);
+                auto add_reverse = [&](std::vector<index_t> &list, index_t j) {
+                    if (list.size() < params.max_candidates) list.push_back(j);
+                    else list[slot(rnd)] = j;
+                };
+                for (index_t j : new_lists[i]) {
+                    std::lock_guard<std::mutex> lock(locks[j]);
+                    add_reverse(new_reverse[j], i);
+                }
+                for (index_t j : old_lists[i]) {
+                    std::lock_guard<std::mutex> lock(locks[j]);
+                    add_reverse(old_reverse[j], i);
+                }
+            });
+            parlay::parallel_for(0, n, [&](size_t i) {
+                new_lists[i].insert(new_lists[i].end(), new_reverse[i].begin(), new_reverse[i].end());
+                old_lists[i].insert(old_lists[i].end(), old_reverse[i].begin(), old_reverse[i].end());
+                std::sort(new_lists[i].begin(), new_lists[i].end());
+                new_lists[i].erase(std::unique(new_lists[i].begin(), new_lists[i].end()), new_lists[i].end());
+                std::sort(old_lists[i].begin(), old_lists[i].end());
+                old_lists[i].erase(std::unique(old_lists[i].begin(), old_lists[i].end()), old_lists[i].end());
+            });
+
+            // Join every new neighbor with the other new neighbors and with the old neighbors
+            std::atomic<size_t> updates = 0;
+            auto join = [&](index_t u, index_t v) {
+                if (u == v) return;
+                value_t dist = points[u].distance(points[v]);
+                size_t changed = 0;
+                {
+                    std::lock_guard<std::mutex> lock(locks[u]);
+                    changed += try_insert<index_t, value_t>(lists[u], k, v, dist);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(locks[v]);
+                    changed += try_insert<index_t, value_t>(lists[v], k, u, dist);
+                }
+                if (changed > 0) updates += changed;
+            };
+            parlay::parallel_for(0, n, [&](size_t i) {
+                auto &new_list = new_lists[i];
+                for (size_t a = 0; a < new_list.size(); a++) {
+                    for (size_t b = a + 1; b < new_list.size(); b++) {
+                        join(new_list[a], new_list[b]);
+                    }
+                    for (index_t u : old_lists[i]) {
+                        join(new_list[a], u);
+                    }
+                }
+            }, 1);
+
+            if (verbose) {
+                std::cout << "NN-descent round " << iter << ": " << updates << " updates" << std::endl;
+            }
+            if (updates < params.delta * n * k) break;
+        }
+
+        std::vector<std::vector<index_t>> neighbors(n);
+        parlay::parallel_for(0, n, [&](size_t i) {
+            neighbors[i].reserve(lists[i].size());
+            for (auto &entry : lists[i]) {
+                neighbors[i].push_back(entry.id);
+            }
+        });
+        return neighbors;
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <parlay/parallel.h>
+
+// Memory placement of large matrices on multi-socket machines
+// Pages are bound with the mbind system call directly, so no NUMA library is needed and single-node machines are unaffected
+enum class NumaPolicy {
+    first_touch, // Leave pages on the node of the thread that first writes them
+    interleave,  // Spread pages round-robin over all nodes
+    rows         // Bind contiguous blocks of rows to each node, in node order
+};
+
+inline const char *numa_policy_name(NumaPolicy policy) {
+    switch (policy) {
+        case NumaPolicy::interleave: return "interleave";
+        case NumaPolicy::rows: return "rows";
+        default: return "first-touch";
+    }
+}
+
+class NumaTopology {
+    // Nodes and their CPUs as listed in sysfs, or a single node holding every CPU when sysfs has no node information
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<int> cpu_nodes;
+
+    static std::vector<int> parse_list(std::string list) {
+        // Lists look like "0-15,32-47"
+        std::vector<int> values;
+        size_t start = 0;
+        while (start < list.size()) {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+            std::string range = list.substr(start, end - start);
+            size_t dash = range.find('-');
+            if (!range.empty() && range[0] != '\n') {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int v = first; v <= last; v++) {
+                    values.push_back(v);
+                }
+            }
+            start = end + 1;
+        }
+        return values;
+    }
+
+    static std::string read_line(std::string filename) {
+        std::ifstream reader(filename);
+        std::string line;
+        std::getline(reader, line);
+        return line;
+    }
+
+    NumaTopology() {
+        for (int node : parse_list(read_line("/sys/devices/system/node/online"))) {
+            if ((size_t)node >= node_cpus.size()) node_cpus.resize(node + 1);
+            node_cpus[node] = parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        }
+        if (node_cpus.empty()) {
+            node_cpus.resize(1);
+            for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF); cpu++) {
+                node_cpus[0].push_back(cpu);
+            }
+        }
+        for (size_t node = 0; node < node_cpus.size(); node++) {
+            for (int cpu : node_cpus[node]) {
+                if ((size_t)cpu >= cpu_nodes.size()) cpu_nodes.resize(cpu + 1, 0);
+                cpu_nodes[cpu] = node;
+            }
+        }
+    }
+
+public:
+    static const NumaTopology &get() {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    size_t num_nodes() const {
+        return node_cpus.size();
+    }
+
+    const std::vector<int> &cpus(size_t node) const {
+        return node_cpus[node];
+    }
+
+    size_t node_of_cpu(int cpu) const {
+        return cpu >= 0 && (size_t)cpu < cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+    }
+
+    size_t current_node() const {
+        return node_of_cpu(sched_getcpu());
+    }
+};
+
+inline size_t numa_restrict(size_t num_nodes) {
+    // Restrict this process to the CPUs of the first num_nodes nodes and return how many CPUs that leaves
+    // Must run before the first parallel operation, since parlay's workers inherit the affinity of the thread that starts them
+    const NumaTopology &topology = NumaTopology::get();
+    num_nodes = std::min(num_nodes, topology.num_nodes());
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    size_t num_cpus = 0;
+    for (size_t node = 0; node < num_nodes; node++) {
+        for (int cpu : topology.cpus(node)) {
+            CPU_SET(cpu, &mask);
+            num_cpus++;
+        }
+    }
+    if (num_cpus == 0 || sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+        std::cerr << "Warning: could not restrict the process to " << num_nodes << " NUMA nodes" << std::endl;
+        return 0;
+    }
+    setenv("PARLAY_NUM_THREADS", std::to_string(num_cpus).data(), 1);
+    return num_cpus;
+}
+
+inline void numa_place(void *data, size_t num_rows, size_t row_bytes, NumaPolicy policy) {
+    // Bind the pages of a row-major matrix before they are first written
+    // Placement only affects performance, so failures such as kernels without NUMA support are ignored
+    constexpr int MPOL_BIND_MODE = 2, MPOL_INTERLEAVE_MODE = 3;
+    const NumaTopology &topology = NumaTopology::get();
+    size_t num_nodes = topology.num_nodes();
+    if (policy == NumaPolicy::first_touch || num_nodes <= 1 || num_rows == 0) return;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)data;
+    uintptr_t end = begin + num_rows * row_bytes;
+    auto bind = [&](uintptr_t start, uintptr_t stop, int mode, const std::vector<unsigned long> &mask) {
+        // Only whole pages inside the range are bound, so pages straddling two nodes' rows are left to first touch
+        start = (start + page_size - 1) / page_size * page_size;
+        stop = stop / page_size * page_size;
+        if (stop <= start) return;
+        syscall(SYS_mbind, (void *)start, stop - start, mode, mask.data(), mask.size() * 8 * sizeof(unsigned long), 0);
+    };
+
+    std::vector<unsigned long> mask((num_nodes + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)), 0);
+    if (policy == NumaPolicy::interleave) {
+        for (size_t node = 0; node < num_nodes; node++) {
+            mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        }
+        bind(begin - begin % page_size, end + page_size - 1, MPOL_INTERLEAVE_MODE, mask);
+        return;
+    }
+    for (size_t node = 0; node < num_nodes; node++) {
+        std::fill(mask.begin(), mask.end(), 0);
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        size_t first = (node * num_rows + num_nodes - 1) / num_nodes;
+        size_t last = ((node + 1) * num_rows + num_nodes - 1) / num_nodes;
+        bind(node == 0 ? begin - begin % page_size : begin + first * row_bytes,
+             node + 1 == num_nodes ? end + page_size - 1 : begin + last * row_bytes, MPOL_BIND_MODE, mask);
+    }
+}
+
+template <typename F>
+void numa_parallel_for(size_t start, size_t end, size_t block_size, NumaPolicy policy, F f) {
+    // Run f on every index, handing each block of indices to a worker on the node that owns its rows when possible
+    // Workers take blocks from their own node first and then from the other nodes, so no node idles while work remains
+    size_t num_nodes = NumaTopology::get().num_nodes();
+    if (policy != NumaPolicy::rows || num_nodes <= 1) {
+        size_t num_blocks = (end - start + block_size - 1) / block_size;
+        parlay::parallel_for(0, num_blocks, [&](size_t b) {
+            for (size_t i = start + b * block_size; i < std::min(start + (b + 1) * block_size, end); i++) {
+                f(i);
+            }
+        }, 1);
+        return;
+    }
+
+    // Node k owns the blocks of indices [k * n / num_nodes, (k + 1) * n / num_nodes)
+    size_t n = end - start;
+    std::vector<size_t> node_start(num_nodes + 1);
+    for (size_t node = 0; node <= num_nodes; node++) {
+        node_start[node] = (node * n + num_nodes - 1) / num_nodes;
+    }
+    std::unique_ptr<std::atomic<size_t>[]> next(new std::atomic<size_t>[num_nodes]);
+    for (size_t node = 0; node < num_nodes; node++) {
+        next[node] = node_start[node];
+    }
+    parlay::parallel_for(0, parlay::num_workers(), [&](size_t) {
+        // The node is looked up before every block since the scheduler may move the worker
+        bool found = true;
+        while (found) {
+            size_t home = NumaTopology::get().current_node() % num_nodes;
+            found = false;
+            for (size_t k = 0; k < num_nodes && !found; k++) {
+                size_t node = (home + k) % num_nodes;
+                size_t claimed = next[node].fetch_add(block_size);
+                if (claimed >= node_start[node + 1]) continue;
+                for (size_t i = claimed; i < std::min(claimed + block_size, node_start[node + 1]); i++) {
+                    f(start + i);
+                }
+                found = true;
+            }
+        }
+    }, 1);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <mutex>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/random.h>
+
+#include "point_set.h"
+#include "distance.h"
+#include "greedy_search.h"
+#include "minimum_navigable_graph.h"
+
+namespace MNG {
+    struct partition_parameters {
+        size_t partition_size;        // Target number of points per partition, bounding the n^2 matrices of each build
+        double max_imbalance;         // Hard cap on the members of a partition, as a multiple of partition_size
+        size_t overlap;               // Number of partitions each point is assigned to
+        size_t stitch;                // Number of nearest foreign partitions each point gets an edge into
+        size_t kmeans_iters;          // Lloyd iterations used to refine the partition centers
+        size_t concurrent_partitions; // Number of partitions built at the same time
+
+        partition_parameters() : partition_size(5000), max_imbalance(1.5), overlap(2), stitch(4), kmeans_iters(3), concurrent_partitions(4) {}
+    };
+
+    inline size_t partition_cap(const partition_parameters &params) {
+        // Partitions never exceed this many members, whatever the clusters of the data look like
+        return std::max<size_t>(1, params.partition_size * std::max(1.0, params.max_imbalance));
+    }
+
+    struct partition_report {
+        size_t num_partitions = 0;
+        size_t max_partition_size = 0;
+        double avg_partition_size = 0;
+        size_t reassigned = 0;        // Memberships moved away from a full partition
+        size_t stitch_edges = 0;
+        size_t max_deg = 0;
+        double avg_deg = 0;
+    };
+
+    template <typename value_t>
+    std::vector<std::vector<value_t>> partition_centers(PointSet<value_t> &points, size_t k, size_t iters) {
+        // Choose k random points as centers and refine them with Lloyd iterations on a sample of the points
+        size_t n = points.size();
+        size_t d = points.dimension();
+        parlay::random_generator gen(0);
+        std::uniform_int_distribution<size_t> dis(0, n - 1);
+        auto sample = parlay::tabulate(std::min(n, 100 * k), [&](size_t i) {
+            auto rnd = gen[i];
+            return dis(rnd);
+        });
+
+        std::vector<std::vector<value_t>> centers(k);
+        for (size_t c = 0; c < k; c++) {
+            const value_t *coords = points[sample[c * sample.size() / k]].data();
+            centers[c].assign(coords, coords + d);
+        }
+
+        for (size_t iter = 0; iter < iters; iter++) {
+            auto assignment = parlay::map(sample, [&](size_t i) {
+                size_t best = 0;
+                value_t best_dist = std::numeric_limits<value_t>::max();
+                for (size_t c = 0; c < k; c++) {
+                    value_t dist = squared_distance(points[i].data(), centers[c].data(), d);
+                    if (dist < best_dist) {
+                        best = c;
+                        best_dist = dist;
+                    }
+                }
+                return best;
+            });
+            std::vector<std::vector<size_t>> members(k);
+            for (size_t j = 0; j < sample.size(); j++) {
+                members[assignment[j]].push_back(sample[j]);
+            }
+            parlay::parallel_for(0, k, [&](size_t c) {
+                // Empty clusters keep their previous center
+                if (members[c].empty()) return;
+                std::vector<double> sum(d, 0);
+                for (size_t i : members[c]) {
+                    for (size_t j = 0; j < d; j++) {
+                        sum[j] += points[i][j];
+                    }
+                }
+                for (size_t j = 0; j < d; j++) {
+                    centers[c][j] = sum[j] / members[c].size();
+                }
+            }, 1);
+        }
+        return centers;
+    }
+
+    template <typename index_t, typename value_t>
+    std::vector<std::vector<index_t>> partitioned_navigable_graph(PointSet<value_t> &points, const partition_parameters &params = partition_parameters(), partition_report *report = nullptr) {
+        // Build a navigable graph without all-pairs data by building minimum navigable graphs on overlapping partitions
+        // Each point joins the partitions of its nearest centers, and points gain edges into their nearest foreign partitions
+        size_t n = points.size();
+        size_t d = points.dimension();
+        size_t k = std::max<size_t>(1, (n * params.overlap + params.partition_size - 1) / params.partition_size);
+        size_t overlap = std::min(params.overlap, k);
+        auto centers = partition_centers(points, k, params.kmeans_iters);
+
+        // Rank the centers by distance from each point
+        size_t keep = std::min(k, overlap + params.stitch);
+        auto nearest_centers = parlay::tabulate(n, [&](size_t i) {
+            std::vector<std::pair<value_t, index_t>> dists(k);
+            for (size_t c = 0; c < k; c++) {
+                dists[c] = {squared_distance(points[i].data(), centers[c].data(), d), (index_t)c};
+            }
+            std::partial_sort(dists.begin(), dists.begin() + keep, dists.end());
+            dists.resize(keep);
+            return dists;
+        });
+
+        // Grant each point its nearest centers in order of distance, so a full partition keeps the members nearest to it
+        // The k partitions hold at least max_imbalance times the n * overlap memberships, so overflow points move
+        // to their nearest partition with room, and only a point left with no such partition joins fewer than overlap
+        size_t cap = partition_cap(params);
+        auto requests = parlay::tabulate(n * overlap, [&](size_t r) {
+            auto [dist, c] = nearest_centers[r / overlap][r % overlap];
+            return std::make_tuple(dist, (index_t)(r / overlap), c);
+        });
+        parlay::sort_inplace(requests);
+        std::vector<std::vector<index_t>> members(k);
+        std::vector<std::vector<index_t>> assigned(n);
+        std::vector<index_t> overflow;
+        for (auto [dist, i, c] : requests) {
+            if (members[c].size() < cap) {
+                members[c].push_back(i);
+                assigned[i].push_back(c);
+            }
+            else overflow.push_back(i);
+        }
+        size_t reassigned = 0;
+        for (index_t i : overflow) {
+            // Every partition the point asked for is by now either granted or full
+            size_t best = k;
+            value_t best_dist = std::numeric_limits<value_t>::max();
+            for (size_t c = 0; c < k; c++) {
+                if (members[c].size() >= cap || std::find(assigned[i].begin(), assigned[i].end(), c) != assigned[i].end()) continue;
+                value_t dist = squared_distance(points[i].data(), centers[c].data(), d);
+                if (dist < best_dist) {
+                    best = c;
+                    best_dist = dist;
+                }
+            }
+            if (best == k) continue;
+            members[best].push_back(i);
+            assigned[i].push_back(best);
+            reassigned++;
+        }
+        parlay::parallel_for(0, k, [&](size_t c) {
+            std::sort(members[c].begin(), members[c].end());
+        }, 1);
+
+        // Build each partition on its own, merging the local edges into the global adjacency lists
+        std::vector<std::vector<index_t>> adjlists(n);
+        std::vector<PointSet<value_t>> local_points(k);
+        std::vector<std::vector<std::vector<index_t>>> local_adjlists(k);
+        std::vector<index_t> entries(k, 0);
+        std::vector<std::mutex> locks(n);
+        for (size_t start = 0; start < k; start += params.concurrent_partitions) {
+            size_t end = std::min(start + params.concurrent_partitions, k);
+            parlay::parallel_for(start, end, [&](size_t c) {
+                if (members[c].empty()) return;
+                local_points[c] = PointSet<value_t>(points, members[c]);
+                if (members[c].size() > 1) {
+                    local_adjlists[c] = minimum_navigable_graph<index_t, value_t>(local_points[c]);
+                }
+                else {
+                    local_adjlists[c].resize(1);
+                }
+
+                // Enter each partition at the member closest to its center
+                value_t best_dist = std::numeric_limits<value_t>::max();
+                for (size_t j = 0; j < members[c].size(); j++) {
+                    value_t dist = squared_distance(local_points[c][j].data(), centers[c].data(), d);
+                    if (dist < best_dist) {
+                        entries[c] = j;
+                        best_dist = dist;
+                    }
+                }
+
+                for (size_t j = 0; j < members[c].size(); j++) {
+                    index_t v = members[c][j];
+                    std::lock_guard<std::mutex> lock(locks[v]);
+                    for (index_t u : local_adjlists[c][j]) {
+                        adjlists[v].push_back(members[c][u]);
+                    }
+                }
+            }, 1);
+        }
+
+        // Stitch each point to the member nearest to it in each of its nearest foreign partitions
+        // A point moved out of a full partition counts it as foreign, so it still gains an edge into it
+        auto stitch_edges = parlay::tabulate(n, [&](size_t i) {
+            size_t added = 0;
+            for (size_t j = 0; j < nearest_centers[i].size() && added < params.stitch; j++) {
+                index_t c = nearest_centers[i][j].second;
+                if (members[c].empty() || std::find(assigned[i].begin(), assigned[i].end(), c) != assigned[i].end()) continue;
+                auto [u, dist_comps] = greedy_search(local_adjlists[c], local_points[c], entries[c], points[i]);
+                adjlists[i].push_back(members[c][u]);
+                added++;
+            }
+            std::sort(adjlists[i].begin(), adjlists[i].end());
+            adjlists[i].erase(std::unique(adjlists[i].begin(), adjlists[i].end()), adjlists[i].end());
+            adjlists[i].erase(std::remove(adjlists[i].begin(), adjlists[i].end(), (index_t)i), adjlists[i].end());
+            return added;
+        });
+
+        if (report != nullptr) {
+            auto sizes = parlay::map(members, [](auto &m) { return m.size(); });
+            auto degrees = parlay::map(adjlists, [](auto &adjlist) { return adjlist.size(); });
+            report->num_partitions = k;
+            report->max_partition_size = parlay::reduce(sizes, parlay::maxm<size_t>());
+            report->reassigned = reassigned;
+            report->avg_partition_size = parlay::reduce(sizes) / (double)k;
+            report->stitch_edges = parlay::reduce(stitch_edges);
+            report->max_deg = parlay::reduce(degrees, parlay::maxm<size_t>());
+            report->avg_deg = parlay::reduce(degrees) / (double)n;
+        }
+        return adjlists;
+    }
+};
@@ -3,8 +3,15 @@
 #include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+
+#include "distance.h"
 
 template <typename value_t = float>
 class PointSet {
@@ -19,7 +26,7 @@ public:
 
         Point(size_t d) : coords(parlay::sequence<value_t>::uninitialized(d)) {}
 
-        Point(size_t id, value_t *coords, size_t d) : _id(id), coords(parlay::sequence<value_t>::uninitialized(d)) {
+        Point(size_t id, const value_t *coords, size_t d) : _id(id), coords(parlay::sequence<value_t>::uninitialized(d)) {
             std::memcpy(this->coords.begin(), coords, d * sizeof(value_t));
         }
 
@@ -37,12 +44,17 @@ public:
             return coords.size();
         }
 
+        const value_t *data() const {
+            return coords.begin();
+        }
+
         value_t distance(const Point &other) const {
-            value_t dist = 0;
-            for (size_t i = 0; i < coords.size(); i++) {
-                dist += (coords[i] - other.coords[i]) * (coords[i] - other.coords[i]);
-            }
-            return dist;
+            return squared_distance(coords.begin(), other.coords.begin(), coords.size());
+        }
+
+        value_t distance(const Point &other, value_t bound) const {
+            // Exact when the distance is at most bound, otherwise some value above bound
+            return squared_distance_bounded(coords.begin(), other.coords.begin(), coords.size(), bound);
         }
 
         bool same_as(const Point &other) const {
@@ -64,7 +76,45 @@ public:
 
     PointSet() : _size(0) {}
 
-    PointSet(const PointSet &other) : _size(other._size), points(other.points) {}
+    PointSet(const PointSet &other) : params(other.params), _size(other._size), points(other.points) {}
+
+    PointSet(PointSet &&other) : params(other.params), _size(other._size), points(std::move(other.points)) {
+        other._size = 0;
+    }
+
+    PointSet &operator=(const PointSet &other) {
+        params = other.params;
+        _size = other._size;
+        points = other.points;
+        return *this;
+    }
+
+    PointSet &operator=(PointSet &&other) {
+        params = other.params;
+        _size = other._size;
+        points = std::move(other.points);
+        other._size = 0;
+        return *this;
+    }
+
+    PointSet(size_t size, size_t dims) : params(dims), _size(size), points(size) {
+        // Placeholder points to be assigned in place
+    }
+
+    PointSet(const PointSet &other, size_t start, size_t end) : params(other.params), _size(end - start) {
+        // Copy a contiguous range of points, renumbering them from zero
+        points = parlay::tabulate(_size, [&](size_t i) {
+            return Point(i, other[start + i].data(), other.dimension());
+        });
+    }
+
+    template <typename Ids>
+    PointSet(const PointSet &other, const Ids &ids) : params(other.params), _size(ids.size()) {
+        // Copy the points with the given ids, renumbering them from zero in the given order
+        points = parlay::tabulate(_size, [&](size_t i) {
+            return Point(i, other[ids[i]].data(), other.dimension());
+        });
+    }
 
     PointSet(std::string filename, size_t head_size = -1ULL) {
         std::ifstream reader(filename);
@@ -102,9 +152,54 @@ public:
         return points[0].size();
     }
 
+    void reserve(size_t capacity) {
+        // Points appended within the reserved capacity never move existing points
+        points.reserve(capacity);
+    }
+
+    void reorder_dimensions(const std::vector<size_t> &order) {
+        // Store dimension order[j] of every point as dimension j, which leaves all distances unchanged
+        // Points compared against these must be reordered the same way
+        parlay::parallel_for(0, _size, [&](size_t i) {
+            auto coords = parlay::tabulate(order.size(), [&](size_t j) {
+                return points[i][order[j]];
+            }, order.size());
+            points[i].coords = std::move(coords);
+        });
+    }
+
+    size_t append(const Point &point) {
+        points.push_back(Point(_size, point.data(), point.size()));
+        return _size++;
+    }
+
     parameters params;
 private:
     size_t _size;
     size_t dims;
     parlay::sequence<Point> points;
-};
\ No newline at end of file
+};
+
+template <typename value_t>
+std::vector<size_t> variance_order(const PointSet<value_t> &points) {
+    // Dimensions sorted by decreasing variance, so bounded distances pass their bound within fewer dimensions
+    size_t n = points.size();
+    size_t d = points.dimension();
+    std::vector<double> variances(d);
+    parlay::parallel_for(0, d, [&](size_t j) {
+        double sum = 0, sum_sq = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += points[i][j];
+            sum_sq += (double)points[i][j] * points[i][j];
+        }
+        variances[j] = sum_sq / n - (sum / n) * (sum / n);
+    }, 1);
+    std::vector<size_t> order(d);
+    for (size_t j = 0; j < d; j++) {
+        order[j] = j;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return variances[a] > variances[b];
+    });
+    return order;
+}
\ No newline at end of file
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/random.h>
+
+#include "point_set.h"
+#include "distance.h"
+#include "entry_points.h"
+
+template <typename value_t = float>
+class ScalarQuantizer {
+    // Each dimension is mapped to 2^bits evenly spaced levels between its minimum and maximum
+    // With 4 bits, dimension 2j is stored in the low nibble and dimension 2j + 1 in the high nibble of byte j
+    size_t _size, dims, bits;
+    std::vector<value_t> mins, scales;
+    parlay::sequence<uint8_t> codes;
+
+public:
+    ScalarQuantizer(PointSet<value_t> &points, size_t bits = 8) : _size(points.size()), dims(points.dimension()), bits(bits), mins(dims), scales(dims) {
+        if (bits != 4 && bits != 8) {
+            std::cerr << "Error: scalar quantization supports 4 or 8 bits" << std::endl;
+            std::abort();
+        }
+        size_t levels = (1 << bits) - 1;
+        parlay::parallel_for(0, dims, [&](size_t j) {
+            value_t min = std::numeric_limits<value_t>::max(), max = std::numeric_limits<value_t>::lowest();
+            for (size_t i = 0; i < _size; i++) {
+                min = std::min(min, points[i][j]);
+                max = std::max(max, points[i][j]);
+            }
+            mins[j] = min;
+            scales[j] = max > min ? (max - min) / levels : 1;
+        }, 1);
+
+        codes = parlay::sequence<uint8_t>(_size * code_size(), 0);
+        parlay::parallel_for(0, _size, [&](size_t i) {
+            uint8_t *code = codes.begin() + i * code_size();
+            for (size_t j = 0; j < dims; j++) {
+                long level = std::lround((points[i][j] - mins[j]) / scales[j]);
+                uint8_t c = std::clamp<long>(level, 0, levels);
+                if (bits == 8) code[j] = c;
+                else code[j / 2] |= c << (4 * (j % 2));
+            }
+        });
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+    inline size_t code_size() const {
+        return bits == 8 ? dims : (dims + 1) / 2;
+    }
+    inline const uint8_t *code(size_t i) const {
+        return codes.begin() + i * code_size();
+    }
+
+    std::vector<value_t> prepare(const value_t *query) const {
+        // Shift the query into the quantized frame so each term is (q_j - c_j * scale_j)^2
+        std::vector<value_t> shifted(dims);
+        for (size_t j = 0; j < dims; j++) {
+            shifted[j] = query[j] - mins[j];
+        }
+        return shifted;
+    }
+
+    value_t distance(const std::vector<value_t> &prepared, size_t i) const {
+        const uint8_t *c = code(i);
+        value_t partial[DISTANCE_LANES] = {};
+        if (bits == 8) {
+            for (size_t j = 0; j < dims; j++) {
+                value_t diff = prepared[j] - c[j] * scales[j];
+                partial[j % DISTANCE_LANES] += diff * diff;
+            }
+        }
+        else {
+            for (size_t j = 0; j < dims; j++) {
+                value_t diff = prepared[j] - ((c[j / 2] >> (4 * (j % 2))) & 15) * scales[j];
+                partial[j % DISTANCE_LANES] += diff * diff;
+            }
+        }
+        value_t dist = 0;
+        for (size_t j = 0; j < DISTANCE_LANES; j++) {
+            dist += partial[j];
+        }
+        return dist;
+    }
+};
+
+template <typename value_t = float>
+class ProductQuantizer {
+    // The dimensions are split into contiguous subspaces, each quantized to one of 256 centroids learned by k-means
+    // Queries build a table of distances to every centroid, so each estimate is one lookup per subspace
+    static constexpr size_t NUM_CENTROIDS = 256;
+
+    size_t _size, dims, num_subspaces;
+    std::vector<size_t> starts; // First dimension of each subspace, with starts[num_subspaces] == dims
+    std::vector<std::vector<value_t>> centroids; // NUM_CENTROIDS x subspace width per subspace, row-major
+    parlay::sequence<uint8_t> codes;
+
+    size_t width(size_t m) const {
+        return starts[m + 1] - starts[m];
+    }
+
+    uint8_t nearest_centroid(size_t m, const value_t *x, size_t num_centroids) const {
+        size_t best = 0;
+        value_t best_dist = std::numeric_limits<value_t>::max();
+        for (size_t c = 0; c < num_centroids; c++) {
+            value_t dist = squared_distance(x, centroids[m].data() + c * width(m), width(m));
+            if (dist < best_dist) {
+                best = c;
+                best_dist = dist;
+            }
+        }
+        return best;
+    }
+
+public:
+    ProductQuantizer(PointSet<value_t> &points, size_t num_subspaces, size_t kmeans_iters = 10, size_t sample_size = 50000)
+        : _size(points.size()), dims(points.dimension()), num_subspaces(std::min(num_subspaces, dims)), starts(this->num_subspaces + 1), centroids(this->num_subspaces) {
+        for (size_t m = 0; m <= this->num_subspaces; m++) {
+            starts[m] = m * dims / this->num_subspaces;
+        }
+
+        // Train every subspace on the same random sample, starting from distinct sample points
+        parlay::random_generator gen(0);
+        std::uniform_int_distribution<size_t> dis(0, _size - 1);
+        auto sample = parlay::tabulate(std::min(_size, sample_size), [&](size_t i) {
+            auto rnd = gen[i];
+            return dis(rnd);
+        });
+        size_t num_centroids = std::min(NUM_CENTROIDS, sample.size());
+        parlay::parallel_for(0, this->num_subspaces, [&](size_t m) {
+            size_t w = width(m);
+            centroids[m].assign(NUM_CENTROIDS * w, 0);
+            for (size_t c = 0; c < num_centroids; c++) {
+                const value_t *x = points[sample[c * sample.size() / num_centroids]].data() + starts[m];
+                std::copy(x, x + w, centroids[m].begin() + c * w);
+            }
+            for (size_t iter = 0; iter < kmeans_iters; iter++) {
+                std::vector<double> sums(num_centroids * w, 0);
+                std::vector<size_t> counts(num_centroids, 0);
+                for (size_t i = 0; i < sample.size(); i++) {
+                    const value_t *x = points[sample[i]].data() + starts[m];
+                    uint8_t c = nearest_centroid(m, x, num_centroids);
+                    counts[c]++;
+                    for (size_t j = 0; j < w; j++) {
+                        sums[c * w + j] += x[j];
+                    }
+                }
+                // Empty clusters keep their previous centroid
+                for (size_t c = 0; c < num_centroids; c++) {
+                    if (counts[c] == 0) continue;
+                    for (size_t j = 0; j < w; j++) {
+                        centroids[m][c * w + j] = sums[c * w + j] / counts[c];
+                    }
+                }
+            }
+        }, 1);
+
+        codes = parlay::sequence<uint8_t>::uninitialized(_size * this->num_subspaces);
+        parlay::parallel_for(0, _size, [&](size_t i) {
+            for (size_t m = 0; m < this->num_subspaces; m++) {
+                codes[i * this->num_subspaces + m] = nearest_centroid(m, points[i].data() + starts[m], num_centroids);
+            }
+        });
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+    inline size_t code_size() const {
+        return num_subspaces;
+    }
+    inline const uint8_t *code(size_t i) const {
+        return codes.begin() + i * num_subspaces;
+    }
+
+    std::vector<value_t> prepare(const value_t *query) const {
+        // Distances from each subspace of the query to each centroid of that subspace
+        std::vector<value_t> table(num_subspaces * NUM_CENTROIDS);
+        for (size_t m = 0; m < num_subspaces; m++) {
+            for (size_t c = 0; c < NUM_CENTROIDS; c++) {
+                table[m * NUM_CENTROIDS + c] = squared_distance(query + starts[m], centroids[m].data() + c * width(m), width(m));
+            }
+        }
+        return table;
+    }
+
+    value_t distance(const std::vector<value_t> &prepared, size_t i) const {
+        const uint8_t *c = code(i);
+        value_t partial[DISTANCE_LANES] = {};
+        for (size_t m = 0; m < num_subspaces; m++) {
+            partial[m % DISTANCE_LANES] += prepared[m * NUM_CENTROIDS + c[m]];
+        }
+        value_t dist = 0;
+        for (size_t j = 0; j < DISTANCE_LANES; j++) {
+            dist += partial[j];
+        }
+        return dist;
+    }
+};
+
+struct quantized_result {
+    uint32_t id;
+    uint32_t estimates; // Distances estimated from codes during traversal
+    uint32_t exact;     // Full-precision distances computed to choose the entry point and rerank
+};
+
+template <typename Graph, typename value_t, typename Quantizer>
+quantized_result quantized_search(Graph &graph, PointSet<value_t> &points, const Quantizer &quantizer, uint32_t source, const typename PointSet<value_t>::Point &query, size_t rerank) {
+    // Greedy search on estimated distances, remembering the rerank closest vertices it evaluates
+    // The closest of those by exact distance seeds a short exact search, so the quantization error only costs hops
+    rerank = std::max<size_t>(rerank, 1);
+    auto prepared = quantizer.prepare(query.data());
+    parlay::sequence<bool> visited(points.size(), false);
+    std::vector<std::pair<value_t, uint32_t>> candidates;
+    candidates.reserve(rerank + 1);
+    auto remember = [&](value_t dist, uint32_t v) {
+        if (candidates.size() == rerank && !(dist < candidates.back().first)) return;
+        candidates.insert(std::upper_bound(candidates.begin(), candidates.end(), std::make_pair(dist, v)), {dist, v});
+        if (candidates.size() > rerank) candidates.pop_back();
+    };
+
+    uint32_t current = source;
+    value_t current_dist = quantizer.distance(prepared, source);
+    uint32_t estimates = 1;
+    remember(current_dist, current);
+    while (!visited[current]) {
+        visited[current] = true;
+        for (uint32_t neighbor : graph[current]) {
+            if (visited[neighbor]) continue;
+            value_t dist = quantizer.distance(prepared, neighbor);
+            estimates++;
+            remember(dist, neighbor);
+            if (dist < current_dist) {
+                current = neighbor;
+                current_dist = dist;
+            }
+            else {
+                visited[neighbor] = true;
+            }
+        }
+    }
+
+    uint32_t best = candidates[0].second;
+    value_t best_dist = std::numeric_limits<value_t>::max();
+    for (auto [estimate, v] : candidates) {
+        value_t dist = points[v].distance(query);
+        if (dist < best_dist) {
+            best = v;
+            best_dist = dist;
+        }
+    }
+
+    // Finish with an exact greedy search from the best candidate, which is usually a few hops from the result
+    auto [result, dist_comps] = greedy_search(graph, points, best, query);
+    return {result, estimates, (uint32_t)candidates.size() + dist_comps - 1};
+}
+
+template <typename Graph, typename value_t, typename Quantizer>
+quantized_result quantized_search(Graph &graph, PointSet<value_t> &points, const Quantizer &quantizer, const EntryPoints &entry, const typename PointSet<value_t>::Point &query, size_t rerank) {
+    auto result = quantized_search(graph, points, quantizer, entry.nearest(points, query), query, rerank);
+    result.exact += entry.size();
+    return result;
+}
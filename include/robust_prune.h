@@ -0,0 +1,219 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+
+#include "point_set.h"
+#include "distance.h"
+#include "mng_utils.h"
+
+namespace Prune {
+    struct parameters {
+        double alpha;           // Candidate u is pruned by neighbor w if alpha * d(w, u) < d(v, u)
+        size_t max_degree;      // Maximum number of neighbors kept per vertex
+        size_t candidate_size;  // Number of nearest points considered as candidates
+        bool neighbor_rule;     // Prune u by w if alpha * d(w, u) < d(v, w) instead, which keeps more edges since d(v, w) <= d(v, u)
+
+        parameters() : alpha(1.0), max_degree(-1ULL), candidate_size(-1ULL), neighbor_rule(false) {}
+        parameters(double alpha, size_t max_degree, size_t candidate_size, bool neighbor_rule = false)
+            : alpha(alpha), max_degree(max_degree), candidate_size(candidate_size), neighbor_rule(neighbor_rule) {}
+    };
+
+    // Number of candidates whose distances to the current neighbors are computed together
+    constexpr size_t BLOCK_SIZE = 64;
+
+    template <typename index_t, typename PointSet>
+    struct point_distances {
+        // Computes candidate-by-neighbor blocks of distances from the coordinates
+        using value_t = typename PointSet::Point::distanceType;
+        PointSet &points;
+        std::vector<const value_t *> a_rows, b_rows;
+
+        point_distances(PointSet &points) : points(points) {}
+
+        void operator()(const index_t *a, size_t num_a, const index_t *b, size_t num_b, value_t *out, const value_t *bounds = nullptr) {
+            // Distances from a[i] may stop early once they exceed bounds[i]
+            a_rows.resize(num_a);
+            b_rows.resize(num_b);
+            for (size_t i = 0; i < num_a; i++) a_rows[i] = points[a[i]].data();
+            for (size_t j = 0; j < num_b; j++) b_rows[j] = points[b[j]].data();
+            distance_block(a_rows.data(), num_a, b_rows.data(), num_b, points.dimension(), out, bounds);
+        }
+    };
+
+    template <typename index_t, typename value_t>
+    struct matrix_distances {
+        // Looks candidate-by-neighbor blocks of distances up in a precomputed distance matrix
+        const DistanceMatrix<value_t> &distances;
+
+        matrix_distances(const DistanceMatrix<value_t> &distances) : distances(distances) {}
+
+        void operator()(const index_t *a, size_t num_a, const index_t *b, size_t num_b, value_t *out, const value_t * = nullptr) {
+            for (size_t i = 0; i < num_a; i++) {
+                const value_t *row = distances[a[i]];
+                for (size_t j = 0; j < num_b; j++) {
+                    out[i * num_b + j] = row[b[j]];
+                }
+            }
+        }
+    };
+
+    template <typename index_t, typename value_t, typename BlockDistances>
+    std::vector<index_t> robust_prune(const index_t *candidates, const value_t *candidate_dists, size_t num_candidates, const parameters &params, BlockDistances &block_distances, std::vector<index_t> neighbors = {}) {
+        // Prune a list of candidates sorted by their distance to the vertex being pruned
+        // Neighbors passed in are kept as they are and prune candidates like any chosen neighbor
+        // Each candidate-to-neighbor distance is computed at most once, and only until it is too far to prune the candidate
+        // Under the neighbor rule, neighbors passed in compare against d(v, u) since their distances to v are not known
+        std::vector<value_t> block(BLOCK_SIZE);
+        std::vector<value_t> bounds(BLOCK_SIZE);
+        std::vector<value_t> cross;
+        std::vector<bool> alive(BLOCK_SIZE);
+        double alpha = params.alpha;
+        std::vector<value_t> neighbor_dists(neighbors.size(), std::numeric_limits<value_t>::max());
+
+        for (size_t start = 0; start < num_candidates && neighbors.size() < params.max_degree; start += BLOCK_SIZE) {
+            size_t block_size = std::min(BLOCK_SIZE, num_candidates - start);
+            const index_t *block_candidates = candidates + start;
+            const value_t *block_dists = candidate_dists + start;
+            std::fill(alive.begin(), alive.end(), true);
+            for (size_t i = 0; i < block_size; i++) {
+                bounds[i] = block_dists[i] / alpha;
+            }
+
+            // Check the whole block against the neighbors chosen before it
+            size_t num_neighbors = neighbors.size();
+            if (num_neighbors > 0) {
+                cross.resize(block_size * num_neighbors);
+                block_distances(block_candidates, block_size, neighbors.data(), num_neighbors, cross.data(), bounds.data());
+                for (size_t i = 0; i < block_size; i++) {
+                    for (size_t k = 0; k < num_neighbors; k++) {
+                        if (alpha * cross[i * num_neighbors + k] < std::min(neighbor_dists[k], block_dists[i])) {
+                            alive[i] = false;
+                            bounds[i] = 0;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Resolve the block in order, pruning later candidates against each neighbor chosen from it
+            // Later candidates are passed as the rows so each distance stops at that candidate's own bound
+            for (size_t i = 0; i < block_size && neighbors.size() < params.max_degree; i++) {
+                if (!alive[i]) continue;
+                neighbors.push_back(block_candidates[i]);
+                neighbor_dists.push_back(params.neighbor_rule ? block_dists[i] : std::numeric_limits<value_t>::max());
+
+                size_t num_rest = block_size - i - 1;
+                if (num_rest == 0) break;
+                block_distances(block_candidates + i + 1, num_rest, block_candidates + i, 1, block.data(), bounds.data() + i + 1);
+                for (size_t j = 0; j < num_rest; j++) {
+                    if (alive[i + 1 + j] && alpha * block[j] < std::min(neighbor_dists.back(), block_dists[i + 1 + j])) {
+                        alive[i + 1 + j] = false;
+                        bounds[i + 1 + j] = 0;
+                    }
+                }
+            }
+        }
+
+        return neighbors;
+    }
+
+    template <typename index_t, typename PointSet>
+    std::vector<index_t> robust_prune(index_t v, PointSet &points, const parameters &params) {
+        // Prune the nearest candidate_size points to v
+        using value_t = typename PointSet::Point::distanceType;
+        size_t n = points.size();
+        std::vector<value_t> distances(n);
+        for (size_t j = 0; j < n; j++) {
+            distances[j] = points[v].distance(points[j]);
+        }
+
+        std::vector<index_t> candidates;
+        candidates.reserve(n - 1);
+        for (size_t j = 0; j < n; j++) {
+            if (j != v) candidates.push_back(j);
+        }
+        auto closer = [&](index_t a, index_t b) {
+            return distances[a] < distances[b];
+        };
+        if (params.candidate_size < candidates.size()) {
+            std::nth_element(candidates.begin(), candidates.begin() + params.candidate_size, candidates.end(), closer);
+            candidates.resize(params.candidate_size);
+        }
+        std::sort(candidates.begin(), candidates.end(), closer);
+
+        std::vector<value_t> candidate_dists(candidates.size());
+        for (size_t j = 0; j < candidates.size(); j++) {
+            candidate_dists[j] = distances[candidates[j]];
+        }
+
+        point_distances<index_t, PointSet> block_distances(points);
+        return robust_prune(candidates.data(), candidate_dists.data(), candidates.size(), params, block_distances);
+    }
+
+    template <typename index_t, typename value_t>
+    std::vector<index_t> robust_prune(index_t v, const PermutationMatrix<index_t> &permutations, const DistanceMatrix<value_t> &distances, const parameters &params) {
+        // Prune using the sorted row of v, reading every distance from the distance matrix
+        size_t n = permutations.size();
+        size_t num_candidates = std::min(params.candidate_size, n - 1);
+        std::vector<index_t> candidates;
+        std::vector<value_t> candidate_dists;
+        candidates.reserve(num_candidates);
+        candidate_dists.reserve(num_candidates);
+        for (size_t j = 0; j < n && candidates.size() < num_candidates; j++) {
+            index_t u = permutations[v][j];
+            if (u == v) continue;
+            candidates.push_back(u);
+            candidate_dists.push_back(distances[v][u]);
+        }
+
+        matrix_distances<index_t, value_t> block_distances(distances);
+        return robust_prune(candidates.data(), candidate_dists.data(), candidates.size(), params, block_distances);
+    }
+
+    template <typename index_t, typename F>
+    parlay::sequence<std::vector<index_t>> prune_all(size_t n, F prune_vertex, bool verbose) {
+        // Prune every vertex in parallel
+        // Progress is reported only by the worker whose fetch_add crosses each percent
+        // The lock is taken at most once per percent, and keeps lines from interleaving or going backwards
+        std::atomic<size_t> progress = 0;
+        std::mutex print_lock;
+        size_t printed = 0;
+        size_t step = std::max<size_t>(1, n / 100);
+        return parlay::tabulate(n, [&](size_t v) {
+            auto neighbors = prune_vertex(v);
+            size_t done = progress.fetch_add(1) + 1;
+            if (verbose && (done % step == 0 || done == n)) {
+                std::lock_guard<std::mutex> lock(print_lock);
+                if (done > printed) {
+                    printed = done;
+                    std::cout << "\rProgress: " << done << "/" << n << std::flush;
+                }
+            }
+            return neighbors;
+        }, 1);
+    }
+
+    template <typename index_t, typename PointSet>
+    parlay::sequence<std::vector<index_t>> prune_graph(PointSet &points, const parameters &params, bool verbose = false) {
+        return prune_all<index_t>(points.size(), [&](size_t v) {
+            return robust_prune<index_t>((index_t)v, points, params);
+        }, verbose);
+    }
+
+    template <typename index_t, typename value_t>
+    parlay::sequence<std::vector<index_t>> prune_graph(const PermutationMatrix<index_t> &permutations, const DistanceMatrix<value_t> &distances, const parameters &params, bool verbose = false) {
+        return prune_all<index_t>(permutations.size(), [&](size_t v) {
+            return robust_prune<index_t>((index_t)v, permutations, distances, params);
+        }, verbose);
+    }
+};
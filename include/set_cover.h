@@ -28,9 +28,12 @@ public:
 
     SetCoverAdjlists(PointSet<value_t> &points) : points(points), distances(points), permutations(distances), ranks(distances, permutations) {}
 
+    SetCoverAdjlists(PointSet<value_t> &points, DistanceMatrix<value_t> &&distances, PermutationMatrix<uint32_t> &&permutations, RankMatrix<uint32_t> &&ranks)
+        : points(points), distances(std::move(distances)), permutations(std::move(permutations)), ranks(std::move(ranks)) {}
+
     uint32_t rank_of(uint32_t i, uint32_t j) {
         // Return the rank of point j in the sorted list of distances from point i
-        return ranks[i * points.size() + j];
+        return ranks[i][j];
     }
 
     bool closer_than(uint32_t i, uint32_t j, uint32_t k) {
@@ -133,7 +136,7 @@ public:
             for (size_t i = 0; i < 50; i++) {
                 uint32_t sample_index = dist(gen) % uncovered_points.size();
                 uint32_t sample_point = uncovered_points[sample_index];
-                uint32_t *perm = permutations.indices.begin() + sample_point * points.size();
+                uint32_t *perm = permutations[sample_point];
                 uint32_t set_boundary = rank_of(sample_point, v);
                 for (uint32_t j = 0; j < set_boundary; j++) {
                     uint32_t set_index = perm[j];
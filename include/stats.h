@@ -0,0 +1,184 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Optional counters for searches and builds
+// Functions take the stats object as a template parameter, and the No* types below have empty methods,
+// so code built without stats compiles to the same loop as before
+
+struct NoSearchStats {
+    void hop() {}
+    void visit() {}
+    void distance() {}
+    void add_visits(uint32_t) {}
+    void add_distances(uint32_t) {}
+};
+
+struct SearchStats {
+    uint32_t hops = 0;       // Vertices whose neighbors were scanned
+    uint32_t visited = 0;    // Vertices marked visited, whether scanned or ruled out
+    uint32_t dist_comps = 0; // Distances computed, including abandoned ones
+
+    void hop() { hops++; }
+    void visit() { visited++; }
+    void distance() { dist_comps++; }
+    void add_visits(uint32_t count) { visited += count; }
+    void add_distances(uint32_t count) { dist_comps += count; }
+};
+
+struct set_cover_counts {
+    size_t votes_cast = 0;    // Votes sampled uncovered points gave to the sets covering them
+    size_t sets_chosen = 0;   // Sets added to adjacency lists, including sets added by the cleanup
+    size_t voters_erased = 0; // Voters removed when a set they voted for was chosen
+};
+
+struct NoBuildStats {
+    void add(const set_cover_counts &) {}
+    void attempt() {}
+};
+
+struct BuildStats {
+    // Instances add their counts once when they finish, so workers rarely contend on the atomics
+    std::atomic<size_t> votes_cast = 0;
+    std::atomic<size_t> sets_chosen = 0;
+    std::atomic<size_t> voters_erased = 0;
+    std::atomic<size_t> attempts = 0; // Rounds of the exponential search over the average degree
+
+    void add(const set_cover_counts &counts) {
+        votes_cast.fetch_add(counts.votes_cast, std::memory_order_relaxed);
+        sets_chosen.fetch_add(counts.sets_chosen, std::memory_order_relaxed);
+        voters_erased.fetch_add(counts.voters_erased, std::memory_order_relaxed);
+    }
+    void attempt() {
+        attempts++;
+    }
+};
+
+class LatencyHistogram {
+    // Log-linear buckets of nanoseconds: 16 linear sub-buckets per power of two, so percentiles are within about 6%
+    // Recording is a relaxed atomic increment, so queries running in parallel can share one histogram
+    static constexpr size_t SUB_BUCKETS = 16;
+    static constexpr size_t NUM_BUCKETS = 64 * SUB_BUCKETS;
+    std::vector<std::atomic<uint64_t>> buckets;
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return ns;
+        size_t exponent = 63 - __builtin_clzll(ns);
+        size_t sub = (ns >> (exponent - 4)) & (SUB_BUCKETS - 1);
+        return (exponent - 3) * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t bucket_value(size_t bucket) {
+        // Upper end of the bucket
+        if (bucket < SUB_BUCKETS) return bucket;
+        size_t exponent = bucket / SUB_BUCKETS + 3;
+        size_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+    }
+
+public:
+    LatencyHistogram() : buckets(NUM_BUCKETS) {}
+
+    void record(uint64_t ns) {
+        buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (auto &bucket : buckets) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint64_t percentile(double p) const {
+        // Nanoseconds below which a fraction p of the recorded latencies fall
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, std::ceil(p * total));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; b++) {
+            seen += buckets[b].load(std::memory_order_relaxed);
+            if (seen >= target) return bucket_value(b);
+        }
+        return bucket_value(NUM_BUCKETS - 1);
+    }
+};
+
+struct perf_sample {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0; // Last level cache misses
+    uint64_t tlb_misses = 0;   // Data TLB load misses
+};
+
+class PerfCounters {
+    // Hardware counters for this process through perf_event_open, inherited by threads created after they are opened
+    // Open them before the first parallel operation so parlay's workers are counted
+    // Where perf events are unavailable, for example in containers without permission, available() is false and samples are zero
+    int fds[4] = {-1, -1, -1, -1};
+    perf_sample start;
+
+    static int open_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    uint64_t read_counter(int fd) const {
+        uint64_t value = 0;
+        if (fd >= 0 && ::read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+        return value;
+    }
+
+    perf_sample read_all() const {
+        return {read_counter(fds[0]), read_counter(fds[1]), read_counter(fds[2]), read_counter(fds[3])};
+    }
+
+public:
+    PerfCounters() {
+        fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        fds[3] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        start = read_all();
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    bool available() const {
+        return fds[0] >= 0;
+    }
+
+    perf_sample next() {
+        // Counts since the previous call, or since the counters were opened
+        perf_sample now = read_all();
+        perf_sample delta = {now.cycles - start.cycles, now.instructions - start.instructions,
+                             now.cache_misses - start.cache_misses, now.tlb_misses - start.tlb_misses};
+        start = now;
+        return delta;
+    }
+};
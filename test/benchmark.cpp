@@ -0,0 +1,672 @@
+#include <iostream>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include <utils/graph.h>
+
+#include "point_set.h"
+#include "mng_utils.h"
+#include "set_cover.h"
+#include "greedy_search.h"
+#include "minimum_navigable_graph.h"
+#include "partitioned_mng.h"
+#include "nn_descent.h"
+#include "robust_prune.h"
+#include "entry_points.h"
+#include "quantization.h"
+#include "ground_truth.h"
+#include "stats.h"
+#include "build_planner.h"
+
+// Every configuration of the sweep runs in its own process, so each has its own thread count and peak RSS
+// Progress goes to stderr and results to stdout as a JSON array with one object per configuration
+
+struct arguments {
+    std::string base_path;
+    std::string query_path;
+    std::string ground_truth_path;
+    std::string graph_path;
+    std::string label;
+    std::string builder;
+    std::vector<std::string> searches;
+    std::vector<size_t> threads;
+    std::vector<size_t> sizes;
+    double alpha;
+    size_t max_degree;
+    size_t candidate_size;
+    size_t knn_size;
+    size_t partition_size;
+    size_t num_pivots;
+    size_t rerank;
+    double memory_budget;
+    size_t concurrency;
+    expansion_parameters expansion;
+    bool counters;
+    bool child;
+};
+
+std::vector<std::string> split(std::string list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+std::vector<size_t> split_sizes(std::string list) {
+    std::vector<size_t> values;
+    for (auto &item : split(list)) {
+        values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+void parse_arguments(int argc, char *argv[], arguments &args) {
+    struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"base_path", required_argument, NULL, 'b'},
+        {"query_path", required_argument, NULL, 'q'},
+        {"ground_truth", required_argument, NULL, 't'},
+        {"graph_path", required_argument, NULL, 'g'},
+        {"label", required_argument, NULL, 'l'},
+        {"builder", required_argument, NULL, 'B'},
+        {"search", required_argument, NULL, 'S'},
+        {"threads", required_argument, NULL, 'T'},
+        {"sizes", required_argument, NULL, 'n'},
+        {"alpha", required_argument, NULL, 'a'},
+        {"max_degree", required_argument, NULL, 'R'},
+        {"candidate_size", required_argument, NULL, 'L'},
+        {"knn_size", required_argument, NULL, 'k'},
+        {"partition_size", required_argument, NULL, 'P'},
+        {"pivots", required_argument, NULL, 'p'},
+        {"rerank", required_argument, NULL, 'r'},
+        {"counters", no_argument, NULL, 'C'},
+        {"memory_budget", required_argument, NULL, 'M'},
+        {"concurrency", required_argument, NULL, 'Q'},
+        {"expand_degree", required_argument, NULL, 'E'},
+        {"expand_workers", required_argument, NULL, 'W'},
+        {"child", no_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0}
+    };
+
+    args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.query_path = "";
+    args.ground_truth_path = "";
+    args.graph_path = "";
+    args.label = "";
+    args.builder = "mng";
+    args.searches = {"greedy", "entry"};
+    args.threads = {};
+    args.sizes = {};
+    args.alpha = 1.0;
+    args.max_degree = -1ULL;
+    args.candidate_size = -1ULL;
+    args.knn_size = 64;
+    args.partition_size = 5000;
+    args.num_pivots = 16;
+    args.rerank = 16;
+    args.counters = false;
+    args.memory_budget = 0;
+    args.concurrency = 0;
+    args.child = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hb:q:t:g:l:B:S:T:n:a:R:L:k:P:p:r:CM:Q:E:W:c", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: ./benchmark [options]" << std::endl;
+                std::cout << "Options:" << std::endl;
+                std::cout << "  -h, --help                     Show this help message" << std::endl;
+                std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
+                std::cout << "  -q, --query_path <path>        Path to the query dataset (default the sampled base points)" << std::endl;
+                std::cout << "  -t, --ground_truth <path>      Ground truth of the queries over all base points, not with -n (default computed)" << std::endl;
+                std::cout << "  -g, --graph_path <path>        Save each graph here, timing the save phase" << std::endl;
+                std::cout << "  -l, --label <label>            Label stored with every result, such as a version" << std::endl;
+                std::cout << "  -B, --builder <name>           greedy, sampling, mng, knn, partitioned, prune or auto (default mng)" << std::endl;
+                std::cout << "  -S, --search <list>            Comma-separated searches: greedy, entry, parallel, sq8, pq (default greedy,entry)" << std::endl;
+                std::cout << "  -T, --threads <list>           Comma-separated thread counts (default all workers)" << std::endl;
+                std::cout << "  -n, --sizes <list>             Comma-separated numbers of base points (default all)" << std::endl;
+                std::cout << "  -a, --alpha <alpha>            Pruning parameter for prune (default 1.0)" << std::endl;
+                std::cout << "  -R, --max_degree <degree>      Maximum degree for prune (default unbounded)" << std::endl;
+                std::cout << "  -L, --candidate_size <size>    Candidates per vertex for prune (default all points)" << std::endl;
+                std::cout << "  -k, --knn_size <size>          Nearest neighbors per point for knn (default 64)" << std::endl;
+                std::cout << "  -P, --partition_size <size>    Target partition size for partitioned (default 5000)" << std::endl;
+                std::cout << "  -p, --pivots <count>           Pivot entry points for the entry searches (default 16)" << std::endl;
+                std::cout << "  -r, --rerank <size>            Candidates reranked by the quantized searches (default 16)" << std::endl;
+                std::cout << "  -C, --counters                 Record hardware counters for every phase where perf events are available" << std::endl;
+                std::cout << "  -M, --memory_budget <GB>       Plan the build first, refusing builders whose estimated peak exceeds the budget" << std::endl;
+                std::cout << "  -Q, --concurrency <count>      Queries in flight at once, for latency at low load (default one per query)" << std::endl;
+                std::cout << "  -E, --expand_degree <degree>   Degree from which parallel splits a scan across workers (default 512)" << std::endl;
+                std::cout << "  -W, --expand_workers <count>   Workers a long scan is split across by parallel (default 4)" << std::endl;
+                exit(EXIT_SUCCESS);
+            case 'b':
+                args.base_path = std::string(optarg);
+                break;
+            case 'q':
+                args.query_path = std::string(optarg);
+                break;
+            case 't':
+                args.ground_truth_path = std::string(optarg);
+                break;
+            case 'g':
+                args.graph_path = std::string(optarg);
+                break;
+            case 'l':
+                args.label = std::string(optarg);
+                break;
+            case 'B':
+                args.builder = std::string(optarg);
+                break;
+            case 'S':
+                args.searches = split(optarg);
+                break;
+            case 'T':
+                args.threads = split_sizes(optarg);
+                break;
+            case 'n':
+                args.sizes = split_sizes(optarg);
+                break;
+            case 'a':
+                args.alpha = std::stod(optarg);
+                break;
+            case 'R':
+                args.max_degree = std::stoull(optarg);
+                break;
+            case 'L':
+                args.candidate_size = std::stoull(optarg);
+                break;
+            case 'k':
+                args.knn_size = std::stoull(optarg);
+                break;
+            case 'P':
+                args.partition_size = std::stoull(optarg);
+                break;
+            case 'p':
+                args.num_pivots = std::stoull(optarg);
+                break;
+            case 'r':
+                args.rerank = std::stoull(optarg);
+                break;
+            case 'C':
+                args.counters = true;
+                break;
+            case 'M':
+                args.memory_budget = std::stod(optarg);
+                break;
+            case 'Q':
+                args.concurrency = std::stoull(optarg);
+                break;
+            case 'E':
+                args.expansion.min_degree = std::stoull(optarg);
+                break;
+            case 'W':
+                args.expansion.max_workers = std::stoull(optarg);
+                break;
+            case 'c':
+                args.child = true;
+                break;
+            default:
+                std::cerr << "Invalid option." << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+    // A ground truth file holds the neighbors among all base points, which a prefix of them may not contain
+    if (!args.ground_truth_path.empty() && !args.sizes.empty()) {
+        std::cerr << "Error: --ground_truth cannot be combined with --sizes, whose ground truth is computed per size" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<std::string> builders = {"greedy", "sampling", "mng", "knn", "partitioned", "prune", "auto"};
+    if (std::find(builders.begin(), builders.end(), args.builder) == builders.end()) {
+        std::cerr << "Unknown builder " << args.builder << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> searches = {"greedy", "entry", "parallel", "sq8", "pq"};
+    for (auto &search : args.searches) {
+        if (std::find(searches.begin(), searches.end(), search) == searches.end()) {
+            std::cerr << "Unknown search " << search << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (args.builder == "auto" && args.memory_budget <= 0) {
+        std::cerr << "The auto builder needs a memory budget" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (args.builder == "prune" && args.memory_budget > 0) {
+        std::cerr << "The planner does not cover the prune builder" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+using index_t = uint32_t;
+using value_t = float;
+
+class JsonObject {
+    // Fields are written in insertion order, and nested objects are added as already formatted values
+    std::vector<std::pair<std::string, std::string>> fields;
+
+public:
+    void add(std::string key, std::string value) {
+        std::string quoted = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+        fields.push_back({key, quoted + "\""});
+    }
+    void add(std::string key, double value) {
+        std::ostringstream stream;
+        stream.precision(10);
+        stream << value;
+        fields.push_back({key, stream.str()});
+    }
+    void add(std::string key, size_t value) {
+        fields.push_back({key, std::to_string(value)});
+    }
+    void add(std::string key, const JsonObject &value) {
+        fields.push_back({key, value.str()});
+    }
+    void add(std::string key, const std::vector<JsonObject> &values) {
+        std::string list = "[";
+        for (size_t i = 0; i < values.size(); i++) {
+            list += (i > 0 ? ", " : "") + values[i].str();
+        }
+        fields.push_back({key, list + "]"});
+    }
+
+    std::string str() const {
+        std::string object = "{";
+        for (size_t i = 0; i < fields.size(); i++) {
+            object += (i > 0 ? ", \"" : "\"") + fields[i].first + "\": " + fields[i].second;
+        }
+        return object + "}";
+    }
+};
+
+JsonObject counter_json(const perf_sample &sample) {
+    JsonObject counters;
+    counters.add("cycles", (size_t)sample.cycles);
+    counters.add("instructions", (size_t)sample.instructions);
+    counters.add("ipc", sample.cycles > 0 ? (double)sample.instructions / sample.cycles : 0.0);
+    counters.add("cache_misses", (size_t)sample.cache_misses);
+    counters.add("tlb_misses", (size_t)sample.tlb_misses);
+    return counters;
+}
+
+double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+std::string run_configuration(arguments &args, size_t size) {
+    // Build one graph and run every requested search on it
+    JsonObject result, phases, counters;
+    parlay::internal::timer timer;
+    // Counters are opened before anything runs in parallel, so every worker thread inherits them
+    std::unique_ptr<PerfCounters> perf;
+    if (args.counters) {
+        perf = std::make_unique<PerfCounters>();
+        if (!perf->available()) {
+            std::cerr << "Warning: perf events are unavailable, so no counters are recorded" << std::endl;
+            perf.reset();
+        }
+    }
+    auto add_phase = [&](std::string name, double time) {
+        phases.add(name, time);
+        if (perf) counters.add(name, counter_json(perf->next()));
+    };
+    auto skip_phase = [&]() {
+        // Discard the time and counts of work that is not a phase
+        timer.next_time();
+        if (perf) perf->next();
+    };
+    PointSet points(args.base_path.data(), size);
+    PointSet queries = args.query_path.empty() ? points : PointSet(args.query_path.data());
+
+    // Plan before anything quadratic is allocated, and refuse a builder whose estimate does not fit
+    std::string builder = args.builder;
+    MNG::build_plan plan;
+    if (args.memory_budget > 0) {
+        MNG::plan_parameters plan_params;
+        plan_params.memory_budget = args.memory_budget * 1e9;
+        plan_params.knn_params.k = args.knn_size;
+        plan_params.partition_params.partition_size = args.partition_size;
+        auto costs = MNG::calibrate_build<index_t, value_t>(points, plan_params);
+        plan = MNG::plan_build<index_t, value_t>(points.size(), points.dimension(), costs, plan_params);
+        std::cerr << "Calibrated on " << std::min(plan_params.calibration_size, points.size()) << " points in " << costs.calibration_time << " seconds" << std::endl;
+        MNG::print_plan(std::cerr, plan);
+        if (builder == "auto") {
+            if (plan.choice() == nullptr) {
+                std::cerr << "Error: no builder fits in " << args.memory_budget << " GB" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            builder = MNG::build_path_name(plan.choice()->path);
+        }
+        for (auto &estimate : plan.estimates) {
+            if (builder == MNG::build_path_name(estimate.path) && !estimate.fits) {
+                std::cerr << "Error: " << builder << " needs an estimated " << estimate.peak_bytes / 1e9 << " GB, over the budget of " << args.memory_budget << " GB" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    result.add("label", args.label);
+    result.add("builder", builder);
+    result.add("threads", (size_t)parlay::num_workers());
+    result.add("concurrency", args.concurrency);
+    result.add("points", points.size());
+    result.add("dims", points.dimension());
+    result.add("queries", queries.size());
+    std::cerr << "Running " << builder << " on " << points.size() << " points with " << parlay::num_workers() << " threads" << std::endl;
+
+    timer.start();
+    if (perf) perf->next();
+    parlay::internal::timer build_timer;
+    build_timer.start();
+    BuildStats build_stats;
+    std::vector<std::vector<index_t>> adjlists;
+    auto to_vectors = [&](auto &&lists) {
+        adjlists.resize(lists.size());
+        parlay::parallel_for(0, lists.size(), [&](size_t i) {
+            adjlists[i].assign(lists[i].begin(), lists[i].end());
+        });
+    };
+    if (builder == "greedy" || builder == "sampling" || builder == "mng") {
+        DistanceMatrix<value_t> distances(points);
+        add_phase("matrix_build", timer.next_time());
+        PermutationMatrix<index_t> permutations(distances);
+        add_phase("sort", timer.next_time());
+        RankMatrix<index_t> ranks(distances, permutations);
+        add_phase("rank", timer.next_time());
+        if (builder == "mng") {
+            adjlists = MNG::minimum_navigable_graph<index_t>(points.size(), permutations, ranks, NumaPolicy::first_touch, build_stats);
+        }
+        else {
+            SetCoverAdjlists<value_t> set_cover(points, std::move(distances), std::move(permutations), std::move(ranks));
+            if (builder == "greedy") to_vectors(set_cover.adjlists_greedy());
+            else to_vectors(set_cover.adjlists_sampling());
+        }
+        add_phase("set_cover", timer.next_time());
+    }
+    else if (builder == "knn") {
+        NNDescent::parameters knn_params;
+        knn_params.k = args.knn_size;
+        auto neighbors = NNDescent::knn_graph<index_t>(points, knn_params);
+        add_phase("knn", timer.next_time());
+        adjlists = MNG::minimum_navigable_graph<index_t, value_t>(points, neighbors, build_stats);
+        add_phase("set_cover", timer.next_time());
+    }
+    else if (builder == "partitioned") {
+        MNG::partition_parameters partition_params;
+        partition_params.partition_size = args.partition_size;
+        adjlists = MNG::partitioned_navigable_graph<index_t>(points, partition_params);
+        add_phase("partitioned_build", timer.next_time());
+    }
+    else {
+        Prune::parameters prune_params(args.alpha, args.max_degree, args.candidate_size);
+        to_vectors(Prune::prune_graph<index_t>(points, prune_params));
+        add_phase("prune", timer.next_time());
+    }
+
+    if (args.memory_budget > 0) {
+        // The estimates of the path that ran, next to what it measured
+        double build_time = build_timer.next_time();
+        double build_peak_mb = peak_rss_mb();
+        JsonObject planned, estimates;
+        for (auto &estimate : plan.estimates) {
+            JsonObject path;
+            path.add("peak_mb", estimate.peak_bytes / 1e6);
+            path.add("seconds", estimate.seconds);
+            path.add("fits", std::string(estimate.fits ? "yes" : estimate.available ? "no" : "unavailable"));
+            estimates.add(MNG::build_path_name(estimate.path), path);
+        }
+        for (auto &estimate : plan.estimates) {
+            if (builder != MNG::build_path_name(estimate.path)) continue;
+            planned.add("estimated_peak_mb", estimate.peak_bytes / 1e6);
+            planned.add("measured_peak_mb", build_peak_mb);
+            planned.add("estimated_seconds", estimate.seconds);
+            planned.add("measured_seconds", build_time);
+            std::cerr << "Planned " << builder << ": " << estimate.peak_bytes / 1e6 << " MB and " << estimate.seconds << " seconds, measured "
+                      << build_peak_mb << " MB and " << build_time << " seconds" << std::endl;
+        }
+        planned.add("budget_mb", args.memory_budget * 1e3);
+        planned.add("estimates", estimates);
+        result.add("plan", planned);
+    }
+
+    if (!args.graph_path.empty()) {
+        size_t max_degree = 0;
+        for (auto &adjlist : adjlists) {
+            max_degree = std::max(max_degree, adjlist.size());
+        }
+        parlayANN::Graph<index_t> graph(max_degree, points.size());
+        parlay::parallel_for(0, points.size(), [&](size_t i) {
+            graph[i].clear_neighbors();
+            for (size_t j = 0; j < adjlists[i].size(); j++) {
+                graph[i].append_neighbor(adjlists[i][j]);
+            }
+        });
+        graph.save(args.graph_path.data());
+        add_phase("save", timer.next_time());
+    }
+
+    if (builder == "mng" || builder == "knn") {
+        JsonObject build;
+        build.add("attempts", build_stats.attempts.load());
+        build.add("votes_cast", build_stats.votes_cast.load());
+        build.add("sets_chosen", build_stats.sets_chosen.load());
+        build.add("voters_erased", build_stats.voters_erased.load());
+        result.add("build", build);
+    }
+
+    auto degrees = parlay::tabulate(adjlists.size(), [&](size_t i) { return adjlists[i].size(); });
+    JsonObject degree;
+    degree.add("min", parlay::reduce(degrees, parlay::minm<size_t>()));
+    degree.add("max", parlay::reduce(degrees, parlay::maxm<size_t>()));
+    degree.add("avg", parlay::reduce(degrees) / (double)adjlists.size());
+    result.add("degree", degree);
+
+    GroundTruth<value_t> ground_truth = args.ground_truth_path.empty()
+        ? GroundTruth<value_t>(points, queries, 1)
+        : GroundTruth<value_t>(args.ground_truth_path);
+    if (ground_truth.size() != queries.size()) {
+        std::cerr << "Error: ground truth size does not match query size" << std::endl;
+        std::abort();
+    }
+    for (size_t i = 0; i < ground_truth.size(); i++) {
+        if (ground_truth.k() == 0 || ground_truth.id(i, 0) >= points.size()) {
+            std::cerr << "Error: ground truth refers to points outside the base dataset" << std::endl;
+            std::abort();
+        }
+    }
+
+    // Entry points and quantizers are prepared outside the timed searches, in their own phases
+    skip_phase();
+    bool needs_entry = std::any_of(args.searches.begin(), args.searches.end(), [](auto &search) { return search != "greedy"; });
+    EntryPoints entry;
+    if (needs_entry) {
+        entry = EntryPoints(points, args.num_pivots);
+        add_phase("entry_points", timer.next_time());
+    }
+
+    std::vector<JsonObject> searches;
+    // The parallel search starts from the same entry point as the entry search, so their tail latencies compare directly
+    double entry_p99 = 0;
+    for (auto &search : args.searches) {
+        // Each query is timed on its own for the latency percentiles, which costs two clock reads per query
+        parlay::sequence<std::pair<uint32_t, uint32_t>> results;
+        parlay::sequence<SearchStats> traces(queries.size());
+        LatencyHistogram latency;
+        bool traced = search == "greedy" || search == "entry" || search == "parallel";
+        double search_time;
+        auto run = [&](auto query_fn) {
+            skip_phase();
+            auto timed_query = [&](size_t i) {
+                auto start = std::chrono::steady_clock::now();
+                auto r = query_fn(queries[i], traces[i]);
+                latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                return r;
+            };
+            if (args.concurrency == 0) {
+                results = parlay::tabulate(queries.size(), timed_query);
+            }
+            else {
+                // A fixed number of streams each run their share of the queries one after another, leaving the other workers idle
+                results = parlay::sequence<std::pair<uint32_t, uint32_t>>(queries.size());
+                parlay::parallel_for(0, args.concurrency, [&](size_t stream) {
+                    for (size_t i = stream; i < queries.size(); i += args.concurrency) {
+                        results[i] = timed_query(i);
+                    }
+                }, 1);
+            }
+            search_time = timer.next_time();
+            add_phase("search_" + search, search_time);
+        };
+        if (search == "greedy") {
+            run([&](auto &query, SearchStats &trace) { return greedy_search(adjlists, points, 0, query, [](uint32_t) { return false; }, trace); });
+        }
+        else if (search == "entry") {
+            run([&](auto &query, SearchStats &trace) { return greedy_search(adjlists, points, entry, query, trace); });
+        }
+        else if (search == "parallel") {
+            run([&](auto &query, SearchStats &trace) { return parallel_greedy_search(adjlists, points, entry, query, args.expansion, trace); });
+        }
+        else if (search == "sq8") {
+            ScalarQuantizer<value_t> quantizer(points, 8);
+            add_phase("quantize_sq8", timer.next_time());
+            run([&](auto &query, SearchStats &) {
+                auto r = quantized_search(adjlists, points, quantizer, entry, query, args.rerank);
+                return std::make_pair(r.id, r.exact);
+            });
+        }
+        else {
+            ProductQuantizer<value_t> quantizer(points, std::max<size_t>(1, points.dimension() / 4));
+            add_phase("quantize_pq", timer.next_time());
+            run([&](auto &query, SearchStats &) {
+                auto r = quantized_search(adjlists, points, quantizer, entry, query, args.rerank);
+                return std::make_pair(r.id, r.exact);
+            });
+        }
+
+        JsonObject stats;
+        stats.add("variant", search);
+        stats.add("time", search_time);
+        stats.add("qps", queries.size() / search_time);
+        stats.add("recall", parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return results[i].first == ground_truth.id(i, 0) ? 1.0 : 0.0;
+        })) / queries.size());
+        stats.add("dist_comps", parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return (double)results[i].second;
+        })) / queries.size());
+        if (traced) {
+            stats.add("hops", parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+                return (double)traces[i].hops;
+            })) / queries.size());
+            stats.add("visited", parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+                return (double)traces[i].visited;
+            })) / queries.size());
+        }
+        stats.add("latency_p50_us", latency.percentile(0.5) / 1e3);
+        stats.add("latency_p99_us", latency.percentile(0.99) / 1e3);
+        stats.add("latency_p999_us", latency.percentile(0.999) / 1e3);
+        if (search == "entry") entry_p99 = latency.percentile(0.99) / 1e3;
+        if (search == "parallel" && entry_p99 > 0) stats.add("p99_vs_entry", latency.percentile(0.99) / 1e3 / entry_p99);
+        searches.push_back(stats);
+    }
+
+    result.add("phases", phases);
+    if (perf) result.add("counters", counters);
+    result.add("searches", searches);
+    result.add("peak_rss_mb", peak_rss_mb());
+    return result.str();
+}
+
+std::string run_child(int argc, char *argv[], size_t threads, size_t size) {
+    // Rerun this program for a single configuration, with the thread count fixed before parlay starts its workers
+    std::vector<std::string> child_args(argv, argv + argc);
+    child_args.push_back("--child");
+    if (threads > 0) child_args.push_back("--threads=" + std::to_string(threads));
+    if (size > 0) child_args.push_back("--sizes=" + std::to_string(size));
+    std::vector<char *> child_argv;
+    for (auto &arg : child_args) {
+        child_argv.push_back(arg.data());
+    }
+    child_argv.push_back(nullptr);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Error: could not create pipe" << std::endl;
+        std::abort();
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (threads > 0) setenv("PARLAY_NUM_THREADS", std::to_string(threads).data(), 1);
+        execv("/proc/self/exe", child_argv.data());
+        std::cerr << "Error: could not run benchmark configuration" << std::endl;
+        _exit(EXIT_FAILURE);
+    }
+    close(fds[1]);
+    std::string output;
+    char buffer[4096];
+    ssize_t bytes;
+    while ((bytes = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, bytes);
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Configuration with " << threads << " threads and " << size << " points failed" << std::endl;
+        return "";
+    }
+    while (!output.empty() && output.back() == '\n') output.pop_back();
+    return output;
+}
+
+int main(int argc, char *argv[]) {
+    arguments args;
+    parse_arguments(argc, argv, args);
+
+    if (args.child) {
+        std::cout << run_configuration(args, args.sizes.empty() ? -1ULL : args.sizes[0]) << std::endl;
+        return 0;
+    }
+
+    std::vector<size_t> threads = args.threads.empty() ? std::vector<size_t>{0} : args.threads;
+    std::vector<size_t> sizes = args.sizes.empty() ? std::vector<size_t>{0} : args.sizes;
+    std::vector<std::string> results;
+    for (size_t size : sizes) {
+        for (size_t t : threads) {
+            std::string result = run_child(argc, argv, t, size);
+            if (!result.empty()) results.push_back(result);
+        }
+    }
+
+    std::cout << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        std::cout << "  " << results[i] << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+    return 0;
+}
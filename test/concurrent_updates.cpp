@@ -0,0 +1,227 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <getopt.h>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "minimum_navigable_graph.h"
+#include "dynamic_graph.h"
+
+struct arguments {
+    std::string base_path;
+    size_t sample_size;
+    size_t initial_size;
+    size_t batch_size;
+    size_t delete_size;
+    size_t num_readers;
+    double duration;
+    double max_regression;
+};
+
+void parse_arguments(int argc, char *argv[], arguments &args) {
+    struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"base_path", required_argument, NULL, 'b'},
+        {"sample_size", required_argument, NULL, 's'},
+        {"initial_size", required_argument, NULL, 'i'},
+        {"batch_size", required_argument, NULL, 'B'},
+        {"delete_size", required_argument, NULL, 'D'},
+        {"readers", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 't'},
+        {"max_regression", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0}
+    };
+
+    args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.sample_size = -1ULL;
+    args.initial_size = 1000;
+    args.batch_size = 100;
+    args.delete_size = 50;
+    args.num_readers = std::max(1u, std::thread::hardware_concurrency() / 2);
+    args.duration = 5;
+    args.max_regression = 0.5;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hb:s:i:B:D:r:t:m:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: ./concurrent_updates [options]" << std::endl;
+                std::cout << "Options:" << std::endl;
+                std::cout << "  -h, --help                     Show this help message" << std::endl;
+                std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
+                std::cout << "  -s, --sample_size <size>       Number of points to sample from the dataset" << std::endl;
+                std::cout << "  -i, --initial_size <size>      Number of points in the initial build (default 1000)" << std::endl;
+                std::cout << "  -B, --batch_size <size>        Number of points per insertion batch (default 100)" << std::endl;
+                std::cout << "  -D, --delete_size <size>       Number of points deleted after each batch (default 50)" << std::endl;
+                std::cout << "  -r, --readers <count>          Number of reader threads (default half the hardware threads)" << std::endl;
+                std::cout << "  -t, --duration <seconds>       Length of each phase (default 5)" << std::endl;
+                std::cout << "  -m, --max_regression <fraction>  Largest accepted QPS drop under updates (default 0.5)" << std::endl;
+                exit(EXIT_SUCCESS);
+            case 'b':
+                args.base_path = std::string(optarg);
+                break;
+            case 's':
+                args.sample_size = std::stoull(optarg);
+                break;
+            case 'i':
+                args.initial_size = std::stoull(optarg);
+                break;
+            case 'B':
+                args.batch_size = std::stoull(optarg);
+                break;
+            case 'D':
+                args.delete_size = std::stoull(optarg);
+                break;
+            case 'r':
+                args.num_readers = std::stoull(optarg);
+                break;
+            case 't':
+                args.duration = std::stod(optarg);
+                break;
+            case 'm':
+                args.max_regression = std::stod(optarg);
+                break;
+            default:
+                std::cerr << "Invalid option." << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+using index_t = uint32_t;
+using value_t = float;
+using Graph_t = DynamicNavigableGraph<value_t, index_t>;
+
+struct reader_stats {
+    size_t queries = 0;
+    size_t found = 0;
+    size_t errors = 0;
+};
+
+reader_stats run_reader(Graph_t &graph, size_t seed, std::atomic<bool> &stop) {
+    // Search for random live points, checking that every result is a valid vertex of the snapshot
+    reader_stats stats;
+    std::mt19937_64 rnd(seed);
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto snapshot = graph.read();
+        size_t n = snapshot.size();
+        if (n == 0) continue;
+        for (size_t i = 0; i < 100; i++) {
+            index_t query = rnd() % n;
+            if (snapshot.is_deleted(query)) continue;
+            auto [result, dist_comps] = snapshot.search(0, query);
+            stats.queries++;
+            if (result >= snapshot.size()) stats.errors++;
+            else if (result == query) stats.found++;
+        }
+    }
+    return stats;
+}
+
+reader_stats run_readers(Graph_t &graph, size_t num_readers, std::atomic<bool> &stop) {
+    std::vector<reader_stats> stats(num_readers);
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < num_readers; r++) {
+        readers.emplace_back([&, r]() { stats[r] = run_reader(graph, r, stop); });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    reader_stats total;
+    for (auto &s : stats) {
+        total.queries += s.queries;
+        total.found += s.found;
+        total.errors += s.errors;
+    }
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    arguments args;
+    parse_arguments(argc, argv, args);
+
+    PointSet all_points(args.base_path.data(), args.sample_size);
+    size_t initial_size = std::min(args.initial_size, all_points.size());
+    std::cout << "Loaded " << all_points.size() << " points" << std::endl;
+    std::cout << "Readers: " << args.num_readers << std::endl;
+
+    PointSet initial_points(all_points, 0, initial_size);
+    auto initial_adjlists = MNG::minimum_navigable_graph<index_t, value_t>(initial_points);
+    Graph_t graph(initial_points, initial_adjlists, all_points.size());
+    std::cout << "Built initial graph on " << initial_size << " points" << std::endl;
+
+    // Read-only phase
+    std::atomic<bool> stop = false;
+    parlay::internal::timer timer;
+    timer.start();
+    std::thread stopper([&]() {
+        std::this_thread::sleep_for(std::chrono::duration<double>(args.duration));
+        stop = true;
+    });
+    auto read_only = run_readers(graph, args.num_readers, stop);
+    stopper.join();
+    double read_only_time = timer.next_time();
+    double read_only_qps = read_only.queries / read_only_time;
+    std::cout << "Read-only QPS: " << read_only_qps << " (recall " << read_only.found / (double)read_only.queries << ")" << std::endl;
+
+    // Mixed phase: a writer inserts, deletes and consolidates while the readers keep searching
+    // The writer stops early once every point has been inserted
+    stop = false;
+    size_t batches = 0, consolidations = 0;
+    timer.start();
+    stopper = std::thread([&]() {
+        std::this_thread::sleep_for(std::chrono::duration<double>(args.duration));
+        stop = true;
+    });
+    std::thread writer([&]() {
+        std::mt19937_64 rnd(-1ULL);
+        for (size_t start = initial_size; start < all_points.size() && !stop; start += args.batch_size) {
+            size_t end = std::min(start + args.batch_size, all_points.size());
+            graph.insert(PointSet(all_points, start, end));
+
+            std::vector<index_t> ids;
+            {
+                // Keep at least half of the initial points live
+                auto snapshot = graph.read();
+                size_t live = snapshot.size() - snapshot.num_deleted();
+                for (size_t i = 0; i < args.delete_size && snapshot.size() > 0 && live - i > initial_size / 2; i++) {
+                    ids.push_back(rnd() % snapshot.size());
+                }
+            }
+            graph.remove(ids);
+            if (graph.maybe_consolidate(0.1)) consolidations++;
+            batches++;
+        }
+    });
+    auto mixed = run_readers(graph, args.num_readers, stop);
+    stopper.join();
+    writer.join();
+    double mixed_time = timer.next_time();
+    double mixed_qps = mixed.queries / mixed_time;
+    std::cout << "Mixed QPS: " << mixed_qps << " (recall " << mixed.found / (double)mixed.queries << ")" << std::endl;
+    std::cout << "Writer batches: " << batches << ", consolidations: " << consolidations << std::endl;
+    std::cout << "Final size: " << graph.size() << ", pending reclamation: " << graph.pending_reclaim() << std::endl;
+
+    double regression = 1 - mixed_qps / read_only_qps;
+    std::cout << "QPS regression: " << regression * 100 << "%" << std::endl;
+
+    size_t errors = read_only.errors + mixed.errors;
+    if (errors > 0) {
+        std::cerr << "Error: " << errors << " searches returned invalid vertices" << std::endl;
+        return 1;
+    }
+    if (regression > args.max_regression) {
+        std::cerr << "Error: QPS regression above " << args.max_regression * 100 << "%" << std::endl;
+        return 1;
+    }
+    return 0;
+}
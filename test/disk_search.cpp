@@ -0,0 +1,202 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "graph_file.h"
+#include "ground_truth.h"
+#include "greedy_search.h"
+#include "entry_points.h"
+#include "minimum_navigable_graph.h"
+#include "quantization.h"
+#include "disk_index.h"
+
+struct arguments {
+    std::string base_path;
+    std::string query_path;
+    std::string graph_path;
+    std::string index_path;
+    size_t sample_size;
+    size_t num_subspaces;
+    size_t beam_width;
+    size_t max_list_size;
+    size_t num_pivots;
+};
+
+void parse_arguments(int argc, char *argv[], arguments &args) {
+    struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"base_path", required_argument, NULL, 'b'},
+        {"query_path", required_argument, NULL, 'q'},
+        {"graph_path", required_argument, NULL, 'g'},
+        {"index_path", required_argument, NULL, 'i'},
+        {"sample_size", required_argument, NULL, 's'},
+        {"subspaces", required_argument, NULL, 'm'},
+        {"beam_width", required_argument, NULL, 'W'},
+        {"list_size", required_argument, NULL, 'L'},
+        {"pivots", required_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0}
+    };
+
+    args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.query_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.graph_path = "";
+    args.index_path = "/ssd1/richard/navgraphs/sift_10K.disk";
+    args.sample_size = -1ULL;
+    args.num_subspaces = 0;
+    args.beam_width = 4;
+    args.max_list_size = 64;
+    args.num_pivots = 16;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hb:q:g:i:s:m:W:L:p:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: ./disk_search [options]" << std::endl;
+                std::cout << "Options:" << std::endl;
+                std::cout << "  -h, --help                     Show this help message" << std::endl;
+                std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
+                std::cout << "  -q, --query_path <path>        Path to the query dataset" << std::endl;
+                std::cout << "  -g, --graph_path <path>        Graph to write to disk (default builds the minimum navigable graph)" << std::endl;
+                std::cout << "  -i, --index_path <path>        Path of the disk index written on the SSD" << std::endl;
+                std::cout << "  -s, --sample_size <size>       Number of points to sample from the dataset" << std::endl;
+                std::cout << "  -m, --subspaces <count>        Product quantization subspaces kept in memory (default dimension / 4)" << std::endl;
+                std::cout << "  -W, --beam_width <size>        Records read together in each expansion (default 4)" << std::endl;
+                std::cout << "  -L, --list_size <size>         Largest candidate list size (default 64)" << std::endl;
+                std::cout << "  -p, --pivots <count>           Number of pivot entry points (default 16)" << std::endl;
+                exit(EXIT_SUCCESS);
+            case 'b':
+                args.base_path = std::string(optarg);
+                break;
+            case 'q':
+                args.query_path = std::string(optarg);
+                break;
+            case 'g':
+                args.graph_path = std::string(optarg);
+                break;
+            case 'i':
+                args.index_path = std::string(optarg);
+                break;
+            case 's':
+                args.sample_size = std::stoull(optarg);
+                break;
+            case 'm':
+                args.num_subspaces = std::stoull(optarg);
+                break;
+            case 'W':
+                args.beam_width = std::stoull(optarg);
+                break;
+            case 'L':
+                args.max_list_size = std::stoull(optarg);
+                break;
+            case 'p':
+                args.num_pivots = std::stoull(optarg);
+                break;
+            default:
+                std::cerr << "Invalid option." << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+using index_t = uint32_t;
+using value_t = float;
+
+struct query_stats {
+    index_t id;
+    double ios;
+    double dist_comps;
+    double latency; // Microseconds
+};
+
+void report(std::string name, const parlay::sequence<query_stats> &stats, const GroundTruth<value_t> &ground_truth, double query_time) {
+    size_t n = stats.size();
+    double recall = parlay::reduce(parlay::tabulate(n, [&](size_t i) {
+        return stats[i].id == ground_truth.id(i, 0) ? 1.0 : 0.0;
+    })) / n;
+    double ios = parlay::reduce(parlay::map(stats, [](auto &s) { return s.ios; })) / n;
+    double dist_comps = parlay::reduce(parlay::map(stats, [](auto &s) { return s.dist_comps; })) / n;
+    auto latencies = parlay::map(stats, [](auto &s) { return s.latency; });
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": recall " << recall << ", QPS " << n / query_time << ", mean I/Os " << ios
+              << ", avg distance comparisons " << dist_comps
+              << ", mean latency " << parlay::reduce(latencies) / n << " us"
+              << ", p99 latency " << latencies[std::min(n - 1, n * 99 / 100)] << " us" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    arguments args;
+    parse_arguments(argc, argv, args);
+
+    PointSet points(args.base_path.data(), args.sample_size);
+    PointSet queries(args.query_path.data(), args.query_path == args.base_path ? args.sample_size : -1ULL);
+    std::cout << "Loaded " << points.size() << " points and " << queries.size() << " queries" << std::endl;
+
+    parlay::internal::timer timer;
+    timer.start();
+    std::vector<std::vector<index_t>> adjlists;
+    if (!args.graph_path.empty()) {
+        adjlists = load_adjlists<index_t>(args.graph_path);
+        std::cout << "Loaded graph in " << timer.next_time() << " seconds" << std::endl;
+    }
+    else {
+        adjlists = MNG::minimum_navigable_graph<index_t, value_t>(points);
+        std::cout << "Built graph in " << timer.next_time() << " seconds" << std::endl;
+    }
+    EntryPoints entry(points, args.num_pivots);
+
+    // Write the graph and full vectors to the SSD and keep only product quantized codes in memory
+    write_disk_index(args.index_path, points, adjlists, entry);
+    std::cout << "Wrote disk index to " << args.index_path << " in " << timer.next_time() << " seconds" << std::endl;
+    size_t num_subspaces = args.num_subspaces > 0 ? args.num_subspaces : std::max<size_t>(1, points.dimension() / 4);
+    ProductQuantizer<value_t> quantizer(points, num_subspaces);
+    std::cout << "Trained PQ" << num_subspaces << " in " << timer.next_time() << " seconds" << std::endl;
+    DiskIndex<value_t, ProductQuantizer<value_t>> index(args.index_path, quantizer, args.beam_width);
+#ifdef USE_IO_URING
+    std::cout << "Reading with io_uring";
+#else
+    std::cout << "Reading with pread";
+#endif
+    std::cout << ", " << index.read_size() << " bytes per record read" << std::endl;
+
+    // Exact nearest neighbor of every query
+    GroundTruth<value_t> ground_truth(points, queries, 1);
+
+    auto time_query = [](auto search) {
+        auto start = std::chrono::steady_clock::now();
+        query_stats stats = search();
+        stats.latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    };
+
+    timer.start();
+    auto memory_stats = parlay::tabulate(queries.size(), [&](size_t i) {
+        return time_query([&]() {
+            auto [id, dist_comps] = greedy_search(adjlists, points, entry, queries[i]);
+            return query_stats{id, 0, (double)dist_comps, 0};
+        });
+    });
+    report("In-memory greedy search", memory_stats, ground_truth, timer.next_time());
+
+    for (size_t list_size = 8; list_size <= args.max_list_size; list_size *= 2) {
+        timer.start();
+        auto disk_stats = parlay::tabulate(queries.size(), [&](size_t i) {
+            return time_query([&]() {
+                auto result = index.search(queries[i].data(), list_size);
+                return query_stats{result.id, (double)result.ios, (double)result.exact, 0};
+            });
+        });
+        report("Disk beam search, L = " + std::to_string(list_size), disk_stats, ground_truth, timer.next_time());
+    }
+
+    return 0;
+}
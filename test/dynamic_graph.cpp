@@ -0,0 +1,222 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <getopt.h>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/random.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "greedy_search.h"
+#include "minimum_navigable_graph.h"
+#include "dynamic_graph.h"
+#include "navigability.h"
+
+struct arguments {
+    std::string base_path;
+    size_t sample_size;
+    size_t initial_size;
+    size_t batch_size;
+    size_t delete_size;
+    size_t num_queries;
+    double consolidate_threshold;
+    bool verify;
+};
+
+void parse_arguments(int argc, char *argv[], arguments &args) {
+    struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"base_path", required_argument, NULL, 'b'},
+        {"sample_size", required_argument, NULL, 's'},
+        {"initial_size", required_argument, NULL, 'i'},
+        {"batch_size", required_argument, NULL, 'B'},
+        {"delete_size", required_argument, NULL, 'D'},
+        {"num_queries", required_argument, NULL, 'Q'},
+        {"consolidate_threshold", required_argument, NULL, 'c'},
+        {"verify", no_argument, NULL, 'V'},
+        {NULL, 0, NULL, 0}
+    };
+
+    args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.sample_size = -1ULL;
+    args.initial_size = 1000;
+    args.batch_size = 100;
+    args.delete_size = 0;
+    args.num_queries = 1000;
+    args.consolidate_threshold = 0.1;
+    args.verify = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hb:s:i:B:D:Q:c:V", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: ./dynamic_graph [options]" << std::endl;
+                std::cout << "Options:" << std::endl;
+                std::cout << "  -h, --help                     Show this help message" << std::endl;
+                std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
+                std::cout << "  -s, --sample_size <size>       Number of points to sample from the dataset" << std::endl;
+                std::cout << "  -i, --initial_size <size>      Number of points in the initial build (default 1000)" << std::endl;
+                std::cout << "  -B, --batch_size <size>        Number of points per insertion batch (default 100)" << std::endl;
+                std::cout << "  -D, --delete_size <size>       Number of points deleted after each batch (default 0)" << std::endl;
+                std::cout << "  -Q, --num_queries <size>       Number of queries after each batch (default 1000)" << std::endl;
+                std::cout << "  -c, --consolidate_threshold <fraction>  Deleted fraction that triggers consolidation (default 0.1)" << std::endl;
+                std::cout << "  -V, --verify                   Check the pairs of each inserted batch, and all live pairs after each consolidation" << std::endl;
+                exit(EXIT_SUCCESS);
+            case 'b':
+                args.base_path = std::string(optarg);
+                break;
+            case 's':
+                args.sample_size = std::stoull(optarg);
+                break;
+            case 'i':
+                args.initial_size = std::stoull(optarg);
+                break;
+            case 'B':
+                args.batch_size = std::stoull(optarg);
+                break;
+            case 'D':
+                args.delete_size = std::stoull(optarg);
+                break;
+            case 'Q':
+                args.num_queries = std::stoull(optarg);
+                break;
+            case 'c':
+                args.consolidate_threshold = std::stod(optarg);
+                break;
+            case 'V':
+                args.verify = true;
+                break;
+            default:
+                std::cerr << "Invalid option." << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    arguments args;
+    parse_arguments(argc, argv, args);
+
+    using index_t = uint32_t;
+    using value_t = float;
+
+    PointSet all_points(args.base_path.data(), args.sample_size);
+    size_t initial_size = std::min(args.initial_size, all_points.size());
+    std::cout << "Loaded " << all_points.size() << " points" << std::endl;
+    std::cout << "Workers: " << parlay::num_workers() << std::endl;
+
+    // Build the initial graph
+    parlay::internal::timer timer;
+    timer.start();
+    PointSet initial_points(all_points, 0, initial_size);
+    auto initial_adjlists = MNG::minimum_navigable_graph<index_t, value_t>(initial_points);
+    DynamicNavigableGraph<value_t, index_t> graph(initial_points, std::move(initial_adjlists));
+    std::cout << "Built initial graph on " << initial_size << " points in " << timer.next_time() << " seconds" << std::endl;
+
+    // Run the mixed workload: insert a batch, delete random live points, then query random live points
+    parlay::random_generator gen(0);
+    std::uniform_int_distribution<size_t> dis;
+    double insert_time = 0, consolidate_time = 0;
+    size_t inserted = 0, deleted = 0, round = 0;
+    for (size_t start = initial_size; start < all_points.size(); start += args.batch_size, round++) {
+        size_t end = std::min(start + args.batch_size, all_points.size());
+        PointSet batch(all_points, start, end);
+        timer.start();
+        index_t first = graph.insert(batch);
+        double batch_time = timer.next_time();
+        insert_time += batch_time;
+        inserted += end - start;
+
+        auto snapshot = graph.read();
+        auto live = parlay::filter(parlay::iota<index_t>(snapshot.size()), [&](index_t i) {
+            return !snapshot.is_deleted(i);
+        });
+        if (args.delete_size > 0) {
+            auto rnd = gen[2 * round];
+            std::shuffle(live.begin(), live.end(), rnd);
+            size_t num_delete = std::min(args.delete_size, live.size() - 1);
+            graph.remove(std::vector<index_t>(live.begin(), live.begin() + num_delete));
+            live = parlay::filter(live, [&](index_t i) { return !snapshot.is_deleted(i); });
+            deleted += num_delete;
+        }
+
+        auto query_ids = parlay::tabulate(args.num_queries, [&](size_t i) {
+            auto rnd = gen[2 * round + 1][i];
+            return live[dis(rnd) % live.size()];
+        });
+        timer.start();
+        auto results = parlay::tabulate(query_ids.size(), [&](size_t i) {
+            return snapshot.search(0, query_ids[i]);
+        });
+        double query_time = timer.next_time();
+        double recall = parlay::reduce(parlay::tabulate(query_ids.size(), [&](size_t i) {
+            return results[i].first == query_ids[i] ? 1.0 : 0.0;
+        })) / query_ids.size();
+
+        std::cout << "Round " << round << ": " << snapshot.size() << " vertices, "
+                  << graph.deleted_fraction() * 100 << "% deleted, "
+                  << batch_time / (end - start) * 1e6 << " us/insert, "
+                  << "QPS " << query_ids.size() / query_time << ", recall " << recall << std::endl;
+
+        if (args.verify) {
+            // Only the pairs to and from the new vertices can have lost their cover, so the check scales with the batch
+            timer.start();
+            auto report = graph.verify_inserted(first, end - start);
+            std::cout << "Insert navigability violations: " << report.violations << "/" << report.checked_pairs
+                      << " pairs in " << timer.next_time() << " seconds" << std::endl;
+        }
+
+        timer.start();
+        bool consolidated = graph.maybe_consolidate(args.consolidate_threshold);
+        if (consolidated) {
+            double time = timer.next_time();
+            consolidate_time += time;
+            std::cout << "Consolidated to " << graph.size() << " vertices in " << time << " seconds" << std::endl;
+        }
+
+        if (args.verify && consolidated) {
+            auto current = graph.read();
+            timer.start();
+            auto report = verify_navigability(current, current.points(), -1ULL, [&](size_t i) {
+                return current.is_deleted(i);
+            });
+            std::cout << "Navigability violations: " << report.violations << "/" << report.checked_pairs
+                      << " pairs in " << timer.next_time() << " seconds" << std::endl;
+        }
+    }
+    std::cout << "Inserted " << inserted << " points in " << insert_time << " seconds" << std::endl;
+    if (inserted > 0) {
+        std::cout << "Avg insertion throughput: " << inserted / insert_time << " points/second" << std::endl;
+    }
+    std::cout << "Deleted " << deleted << " points, consolidation took " << consolidate_time << " seconds" << std::endl;
+
+    auto snapshot = graph.read();
+    auto degrees = parlay::tabulate(snapshot.size(), [&](size_t i) { return snapshot[i].size(); });
+    std::cout << "Max degree: " << parlay::reduce(degrees, parlay::maxm<size_t>()) << std::endl;
+    std::cout << "Avg degree: " << parlay::reduce(degrees) / (double)snapshot.size() << std::endl;
+
+    // Search for every live point
+    auto live = parlay::filter(parlay::iota<index_t>(snapshot.size()), [&](index_t i) {
+        return !snapshot.is_deleted(i);
+    });
+    timer.start();
+    auto results = parlay::tabulate(live.size(), [&](size_t i) {
+        return snapshot.search(0, live[i]);
+    });
+    double query_time = timer.next_time();
+
+    std::cout << "Recall: " << parlay::reduce(parlay::tabulate(live.size(), [&](size_t i) {
+        return results[i].first == live[i] ? 1.0 : 0.0;
+    })) / (double)live.size() << std::endl;
+    std::cout << "Avg distance comparisons: " << parlay::reduce(parlay::tabulate(live.size(), [&](size_t i) {
+        return results[i].second;
+    })) / (double)live.size() << std::endl;
+    std::cout << "Query time: " << query_time << " seconds" << std::endl;
+    std::cout << "Avg QPS: " << live.size() / query_time << std::endl;
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <fstream>
 #include <getopt.h>
 
 #include <parlay/sequence.h>
@@ -8,17 +9,22 @@
 #include <parlay/internal/get_time.h>
 
 #include <utils/types.h>
-#include <utils/graph.h>
 
 #include "point_set.h"
+#include "graph_file.h"
 #include "greedy_search.h"
+#include "entry_points.h"
+#include "ground_truth.h"
 
 struct arguments {
     std::string graph_file;
     std::string base_file;
     std::string query_file;
     std::string ground_truth_file;
+    std::string entry_file;
     size_t k;
+    size_t num_pivots;
+    bool order_dimensions;
 };
 
 void print_args(arguments &args) {
@@ -28,7 +34,12 @@ void print_args(arguments &args) {
     if (!args.ground_truth_file.empty()) {
         std::cout << "Ground truth file: " << args.ground_truth_file << std::endl;
     }
+    if (!args.entry_file.empty()) {
+        std::cout << "Entry point file: " << args.entry_file << std::endl;
+    }
     std::cout << "k: " << args.k << std::endl;
+    std::cout << "Pivots: " << args.num_pivots << std::endl;
+    std::cout << "Order dimensions by variance: " << (args.order_dimensions ? "yes" : "no") << std::endl;
 }
 
 void print_usage(char *progname) {
@@ -37,8 +48,11 @@ void print_usage(char *progname) {
     std::cerr << "  -g, --graph <file>           Graph file\n";
     std::cerr << "  -b, --base <file>            Base file\n";
     std::cerr << "  -q, --query <file>           Query file\n";
-    std::cerr << "  -t, --ground_truth <file>    Ground truth file\n";
+    std::cerr << "  -t, --ground_truth <file>    Ground truth file, created if it does not exist\n";
+    std::cerr << "  -e, --entry <file>           Entry point file, created if it does not exist\n";
     std::cerr << "  -k, --k <int>                Number of neighbors to search for\n";
+    std::cerr << "  -p, --pivots <int>           Number of pivot entry points to compute\n";
+    std::cerr << "  -o, --order_dimensions       Reorder dimensions by decreasing variance so distances stop earlier\n";
     std::cerr << "  -h, --help                   Print this help message\n";
 }
 
@@ -48,7 +62,10 @@ void parse_args(int argc, char *argv[], arguments &args) {
         {"base", required_argument, 0, 'b'},
         {"query", required_argument, 0, 'q'},
         {"ground_truth", required_argument, 0, 't'},
+        {"entry", required_argument, 0, 'e'},
         {"k", required_argument, 0, 'k'},
+        {"pivots", required_argument, 0, 'p'},
+        {"order_dimensions", no_argument, 0, 'o'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
@@ -57,10 +74,13 @@ void parse_args(int argc, char *argv[], arguments &args) {
     args.base_file = "/ssd1/richard/navgraphs/sift_10K.fbin";
     args.query_file = "/ssd1/richard/navgraphs/sift_10K.fbin";
     args.ground_truth_file = "";
+    args.entry_file = "";
     args.k = 1;
+    args.num_pivots = 16;
+    args.order_dimensions = false;
 
     int c;
-    while ((c = getopt_long(argc, argv, "g:b:q:t:k:h", long_options, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "g:b:q:t:e:k:p:oh", long_options, NULL)) != -1) {
         switch (c) {
             case 'g':
                 args.graph_file = optarg;
@@ -74,9 +94,18 @@ void parse_args(int argc, char *argv[], arguments &args) {
             case 't':
                 args.ground_truth_file = optarg;
                 break;
+            case 'e':
+                args.entry_file = optarg;
+                break;
             case 'k':
                 args.k = std::atoi(optarg);
                 break;
+            case 'p':
+                args.num_pivots = std::atoi(optarg);
+                break;
+            case 'o':
+                args.order_dimensions = true;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 exit(0);
@@ -93,90 +122,103 @@ int main(int argc, char *argv[]) {
     print_args(args);
 
     // Load graph
-    parlayANN::Graph<uint32_t> graph(args.graph_file.data());
-    std::cout << "Loaded graph with " << graph.size() << " vertices" << std::endl;
+    auto adjlists = load_adjlists<uint32_t>(args.graph_file);
+    std::cout << "Loaded graph with " << adjlists.size() << " vertices" << std::endl;
 
     // Load points
-    PointSet points(args.base_file.data(), graph.size());
+    PointSet points(args.base_file.data(), adjlists.size());
     PointSet queries = (args.query_file == args.base_file)
-        ? PointSet(args.base_file.data(), graph.size())
+        ? PointSet(args.base_file.data(), adjlists.size())
         : PointSet(args.query_file.data());
     std::cout << "Loaded " << points.size() << " points" << std::endl;
     std::cout << "Loaded " << queries.size() << " queries" << std::endl;
+    if (args.order_dimensions) {
+        auto order = variance_order(points);
+        points.reorder_dimensions(order);
+        queries.reorder_dimensions(order);
+    }
 
-    // Compute the adjacency lists
-    parlay::sequence<std::vector<uint32_t>> adjlists = parlay::tabulate(graph.size(), [&](size_t i) {
-        std::vector<uint32_t> adjlist;
-        for (size_t j = 0; j < graph[i].size(); j++) {
-            adjlist.push_back(graph[i][j]);
-        }
-        return adjlist;
-    });
-
-    // Compute the ground truth
-    parlay::sequence<parlay::sequence<uint32_t>> ground_truth;
-    if (!args.ground_truth_file.empty()) {
-        std::cout << "Loading ground truth from " << args.ground_truth_file << std::endl;
-        parlayANN::groundTruth<uint32_t> gt(args.ground_truth_file.data());
-        if (gt.size() != queries.size()) {
+    // Load the ground truth, computing it and saving it to the -t file only when that file does not exist yet
+    GroundTruth<float> ground_truth;
+    if (!args.ground_truth_file.empty() && std::ifstream(args.ground_truth_file).good()) {
+        ground_truth = GroundTruth<float>(args.ground_truth_file);
+        std::cout << "Loaded ground truth from " << args.ground_truth_file << std::endl;
+        if (ground_truth.size() != queries.size()) {
             std::cerr << "Error: ground truth size does not match query size" << std::endl;
             return 1;
         }
-        ground_truth = parlay::tabulate(queries.size(), [&](size_t i) {
-            parlay::sequence<uint32_t> neighbors;
-            neighbors.reserve(args.k);
-            for (size_t j = 0; j < args.k; j++) {
-                neighbors.push_back(gt.coordinates(i, j));
-            }
-            return neighbors;
-        });
+        if (ground_truth.k() < args.k) {
+            std::cerr << "Error: ground truth holds " << ground_truth.k() << " neighbors per query, fewer than k" << std::endl;
+            return 1;
+        }
     }
     else {
         std::cout << "Computing ground truth" << std::endl;
-        ground_truth = parlay::tabulate(queries.size(), [&](size_t i) {
-            auto distances = parlay::tabulate(points.size(), [&](size_t j) {
-                return points[j].distance(queries[i]);
-            });
-            auto indices = parlay::tabulate(points.size(), [&](size_t j) {
-                return j;
-            });
-            std::sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
-                return distances[a] < distances[b];
-            });
-
-            parlay::sequence<uint32_t> neighbors(args.k);
-            std::copy(indices.begin(), indices.begin() + args.k, neighbors.begin());
-            return neighbors;
-        });
+        parlay::internal::timer timer;
+        timer.start();
+        ground_truth = GroundTruth<float>(points, queries, args.k);
+        std::cout << "Computed ground truth in " << timer.next_time() << " seconds" << std::endl;
+        if (!args.ground_truth_file.empty()) ground_truth.save(args.ground_truth_file);
+    }
+    // The computed ground truth holds at most one neighbor per base point, so recall is measured at no larger k
+    if (ground_truth.k() < args.k) {
+        std::cout << "Measuring recall at k = " << ground_truth.k() << ", the number of base points" << std::endl;
+        args.k = ground_truth.k();
     }
 
-    // Perform queries
-    parlay::internal::timer timer;
-    timer.start();
-    auto results = parlay::tabulate(points.size(), [&](size_t i) {
-        auto [neighbor, dist_comps] = greedy_search(adjlists, points, 0, i);
-        return std::make_pair(neighbor, dist_comps);
-    });
-    double query_time = timer.next_time();
-
-    // Compute recall
-    size_t correct = 0;
-    for (size_t i = 0; i < queries.size(); i++) {
-        for (size_t j = 0; j < args.k; j++) {
-            if (results[i].first == ground_truth[i][j]) {
-                correct++;
-                break;
+    // Load or compute the entry points
+    EntryPoints entry;
+    if (!args.entry_file.empty() && std::ifstream(args.entry_file).good()) {
+        entry = EntryPoints(args.entry_file, points.size());
+        std::cout << "Loaded " << entry.size() << " entry points" << std::endl;
+    }
+    else {
+        entry = EntryPoints(points, args.num_pivots);
+        std::cout << "Computed " << entry.size() << " entry points (medoid " << entry.pivots[0] << ")" << std::endl;
+        if (!args.entry_file.empty()) entry.save(args.entry_file);
+    }
+
+    // Perform queries from vertex 0 and from the nearest entry point
+    auto run_queries = [&](auto search) {
+        parlay::internal::timer timer;
+        timer.start();
+        auto results = parlay::tabulate(queries.size(), [&](size_t i) {
+            return search(queries[i]);
+        });
+        double query_time = timer.next_time();
+
+        // Compute recall
+        size_t correct = 0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            for (size_t j = 0; j < args.k; j++) {
+                if (results[i].first == ground_truth.id(i, j)) {
+                    correct++;
+                    break;
+                }
             }
         }
-    }
-    double recall = correct / (double)queries.size() / args.k;
-
-    std::cout << "Recall: " << recall << std::endl;
-    std::cout << "Avg distance comparisons: " << parlay::reduce(parlay::tabulate(points.size(), [&](size_t i) {
-        return results[i].second;
-    })) / (double)points.size() << std::endl;
-    std::cout << "Query time: " << query_time << " seconds" << std::endl;
-    std::cout << "Avg QPS: " << points.size() / query_time << std::endl;
+        double recall = correct / (double)queries.size() / args.k;
+        double dist_comps = parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return results[i].second;
+        })) / (double)queries.size();
+
+        std::cout << "Recall: " << recall << std::endl;
+        std::cout << "Avg distance comparisons: " << dist_comps << std::endl;
+        std::cout << "Query time: " << query_time << " seconds" << std::endl;
+        std::cout << "Avg QPS: " << queries.size() / query_time << std::endl;
+        return dist_comps;
+    };
+
+    std::cout << "Searching from vertex 0" << std::endl;
+    double fixed_comps = run_queries([&](auto &query) {
+        return greedy_search(adjlists, points, 0, query);
+    });
+    std::cout << "Searching from the nearest of " << entry.size() << " entry points" << std::endl;
+    double entry_comps = run_queries([&](auto &query) {
+        return greedy_search(adjlists, points, entry, query);
+    });
+    std::cout << "Avg distance comparisons: " << fixed_comps << " -> " << entry_comps
+              << " (" << (entry_comps / fixed_comps - 1) * 100 << "%)" << std::endl;
 
     return 0;
 }
\ No newline at end of file
@@ -19,9 +19,23 @@
 #include "set_cover.h"
 #include "greedy_search.h"
 #include "minimum_navigable_graph.h"
+#include "partitioned_mng.h"
+#include "navigability.h"
+#include "entry_points.h"
+#include "matrix_cache.h"
+#include "numa.h"
 
 #define PARALLEL 1
 #define MODE 2
+#define MAX_DEGREE 64
+#define PARTITION_SIZE 5000
+#define EXACT_LIMIT 20000
+#define KNN_SIZE 64
+#define MAX_VIOLATIONS 1000000
+#define NUM_PIVOTS 16
+#define MATRIX_CACHE 0 // Map the matrices from the cache next to the datasets, which needs room for three n^2 matrices
+#define NUMA_POLICY NumaPolicy::first_touch
+#define NUMA_NODES 0 // Run on the first NUMA_NODES nodes, or on all of them when 0
 
 int main(int argc, char* argv[]) {
     std::string test = "sift_10K";
@@ -38,6 +52,11 @@ int main(int argc, char* argv[]) {
     using GroundTruth_t = parlayANN::groundTruth<index_t>;
     using Graph_t = parlayANN::Graph<index_t>;
 
+    // Restrict the workers to some of the nodes before any parallel work starts them
+    if (NUMA_NODES > 0) numa_restrict(NUMA_NODES);
+    std::cout << "NUMA nodes: " << (NUMA_NODES > 0 ? std::min<size_t>(NUMA_NODES, NumaTopology::get().num_nodes()) : NumaTopology::get().num_nodes())
+              << "/" << NumaTopology::get().num_nodes() << ", placement: " << numa_policy_name(NUMA_POLICY) << std::endl;
+
     // Load the points
     std::cout << "Loading test: " << test << std::endl;
     PointSet points("/ssd1/richard/navgraphs/" + test + ".fbin", sample_size);
@@ -49,8 +68,28 @@ int main(int argc, char* argv[]) {
     parlay::internal::timer timer;
     timer.start();
 
+    #if MODE <= 3
+        #if MATRIX_CACHE
+            // Map the matrices from earlier runs on the same points, building and saving any that are missing
+            MatrixCache<index_t, value_t> cache("/ssd1/richard/navgraphs/cache", "/ssd1/richard/navgraphs/" + test + ".fbin", points, NUMA_POLICY);
+            auto distances = cache.distances(points);
+            auto permutations = cache.permutations(distances);
+            auto ranks = cache.ranks(distances, permutations);
+            std::cout << "Matrices: " << cache.report.hits << " mapped in " << cache.report.load_time << " seconds, "
+                      << cache.report.misses << " built in " << cache.report.build_time << " seconds" << std::endl;
+            if (cache.report.hits > 0) {
+                std::cout << "Time saved by the matrix cache: " << cache.report.saved_time << " seconds" << std::endl;
+            }
+        #else
+            DistanceMatrix<value_t> distances(points, NUMA_POLICY);
+            PermutationMatrix<index_t> permutations(distances, NUMA_POLICY);
+            RankMatrix<index_t> ranks(distances, permutations, NUMA_POLICY);
+        #endif
+        std::cout << "Matrices ready in " << timer.next_time() << " seconds" << std::endl;
+    #endif
+
     #if MODE == 0 // Greedy
-        SetCoverAdjlists<value_t> set_cover(points);
+        SetCoverAdjlists<value_t> set_cover(points, std::move(distances), std::move(permutations), std::move(ranks));
         #if PARALLEL
             auto adjlists = set_cover.adjlists_greedy();
         #else
@@ -61,7 +100,7 @@ int main(int argc, char* argv[]) {
             }
         #endif
     #elif MODE == 1 // Sampling
-        SetCoverAdjlists<value_t> set_cover(points);
+        SetCoverAdjlists<value_t> set_cover(points, std::move(distances), std::move(permutations), std::move(ranks));
         #if PARALLEL
             auto adjlists = set_cover.adjlists_sampling();
         #else
@@ -74,7 +113,22 @@ int main(int argc, char* argv[]) {
             }
         #endif
     #elif MODE == 2 // Quadratic
-        auto adjlists = MNG::minimum_navigable_graph<index_t, value_t>(points);
+        auto adjlists = MNG::minimum_navigable_graph<index_t>(points.size(), permutations, ranks, NUMA_POLICY);
+    #elif MODE == 3 // Degree-bounded quadratic
+        auto unbounded = MNG::minimum_navigable_graph<index_t>(points.size(), permutations, ranks, NUMA_POLICY);
+        auto adjlists = unbounded;
+        auto report = MNG::bound_degree<index_t>(adjlists, MAX_DEGREE, permutations, ranks);
+    #elif MODE == 4 // Partitioned
+        MNG::partition_parameters partition_params;
+        partition_params.partition_size = PARTITION_SIZE;
+        MNG::partition_report report;
+        auto adjlists = MNG::partitioned_navigable_graph<index_t>(points, partition_params, &report);
+    #elif MODE == 5 // Approximate nearest neighbor lists
+        NNDescent::parameters knn_params;
+        knn_params.k = KNN_SIZE;
+        auto neighbors = NNDescent::knn_graph<index_t>(points, knn_params, true);
+        std::cout << "Nearest neighbor lists computed in " << timer.next_time() << " seconds" << std::endl;
+        auto adjlists = MNG::minimum_navigable_graph<index_t, value_t>(points, neighbors);
     #else
         #error "Invalid mode"
     #endif
@@ -88,6 +142,12 @@ int main(int argc, char* argv[]) {
     std::cout << "Max degree: " << max_degree << std::endl;
     std::cout << "Avg degree: " << avg_degree << std::endl;
 
+    // Check every pair for a neighbor strictly closer to the target
+    timer.start();
+    auto navigability = verify_navigability(adjlists, points, MAX_VIOLATIONS);
+    std::cout << "Navigability violations: " << navigability.violations << "/" << navigability.checked_pairs << " pairs"
+              << (navigability.complete ? "" : " (stopped early)") << " in " << timer.next_time() << " seconds" << std::endl;
+
     // Construct the graph
     std::cout << "Constructing graph" << std::endl;
     Graph_t graph(max_degree, points.size());
@@ -99,6 +159,11 @@ int main(int argc, char* argv[]) {
     });
     graph.save(("/ssd1/richard/navgraphs/" + test + ".graph").data());
 
+    // Choose and save the entry points searches start from
+    EntryPoints entry(points, NUM_PIVOTS);
+    entry.save("/ssd1/richard/navgraphs/" + test + ".entry");
+    std::cout << "Entry points: " << entry.size() << " (medoid " << entry.pivots[0] << ")" << std::endl;
+
     // Test QPS/recall
     std::cout << "Testing recall" << std::endl;
     // auto [avg_deg, max_deg] = parlayANN::graph_stats_(graph);
@@ -107,7 +172,7 @@ int main(int argc, char* argv[]) {
 
     timer.start();
     auto results = parlay::tabulate(queries.size(), [&](size_t i) {
-        auto [neighbor, dist_comps] = greedy_search(adjlists, points, 0, i);
+        auto [neighbor, dist_comps] = greedy_search(adjlists, points, entry, i);
         return std::make_pair(neighbor, dist_comps);
     });
     double query_time = timer.next_time();
@@ -132,5 +197,54 @@ int main(int argc, char* argv[]) {
     std::cout << "Query time: " << query_time << " seconds" << std::endl;
     std::cout << "Avg QPS: " << queries.size() / query_time << std::endl;
 
+    #if MODE == 3
+        // Compare against the unbounded graph
+        auto unbounded_results = parlay::tabulate(queries.size(), [&](size_t i) {
+            return greedy_search(unbounded, points, entry, i);
+        });
+        double unbounded_comps = parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return unbounded_results[i].second;
+        })) / (double)queries.size();
+        double bounded_comps = parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return results[i].second;
+        })) / (double)queries.size();
+        std::cout << "Degree bound: " << MAX_DEGREE << std::endl;
+        std::cout << "Overflowing vertices: " << report.overflow_vertices << std::endl;
+        std::cout << "Removed edges: " << report.removed_edges << " (" << report.redistributed_edges << " redistributed)" << std::endl;
+        std::cout << "Edges recovered outside the unbounded lists: " << report.recovered_edges << std::endl;
+        std::cout << "Uncovered pairs: " << report.uncovered_pairs << (report.navigable ? "" : " (not navigable under the bound)") << std::endl;
+        std::cout << "Max degree: " << report.unbounded_max_deg << " -> " << report.bounded_max_deg << std::endl;
+        std::cout << "Avg degree: " << report.unbounded_avg_deg << " -> " << report.bounded_avg_deg
+                  << " (" << (report.bounded_avg_deg / report.unbounded_avg_deg - 1) * 100 << "%)" << std::endl;
+        std::cout << "Avg distance comparisons: " << unbounded_comps << " -> " << bounded_comps
+                  << " (" << (bounded_comps / unbounded_comps - 1) * 100 << "%)" << std::endl;
+    #elif MODE == 4
+        std::cout << "Partitions: " << report.num_partitions << " (max size " << report.max_partition_size
+                  << ", avg size " << report.avg_partition_size << ", " << report.reassigned << " memberships reassigned)" << std::endl;
+        std::cout << "Stitch edges: " << report.stitch_edges << std::endl;
+    #endif
+
+    #if MODE == 4 || MODE == 5
+        // Compare with the exact build when its matrices fit
+        if (points.size() <= EXACT_LIMIT) {
+            timer.start();
+            auto exact = MNG::minimum_navigable_graph<index_t, value_t>(points);
+            double exact_time = timer.next_time();
+            auto exact_sizes = parlay::map(exact, [](auto &adjlist) { return adjlist.size(); });
+            auto exact_results = parlay::tabulate(queries.size(), [&](size_t i) {
+                return greedy_search(exact, points, entry, i);
+            });
+            std::cout << "Exact build time: " << exact_time << " seconds" << std::endl;
+            std::cout << "Exact max degree: " << parlay::reduce(exact_sizes, parlay::maxm<size_t>()) << std::endl;
+            std::cout << "Exact avg degree: " << parlay::reduce(exact_sizes) / (double)exact.size() << std::endl;
+            std::cout << "Exact recall: " << parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+                return exact_results[i].first == i ? 1.0 : 0.0;
+            })) / (double)queries.size() << std::endl;
+            std::cout << "Exact avg distance comparisons: " << parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+                return exact_results[i].second;
+            })) / (double)queries.size() << std::endl;
+        }
+    #endif
+
     return 0;
 }
\ No newline at end of file
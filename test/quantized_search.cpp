@@ -0,0 +1,181 @@
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include <parlay/sequence.h>
+#include <parlay/parallel.h>
+#include <parlay/primitives.h>
+#include <parlay/internal/get_time.h>
+
+#include "point_set.h"
+#include "graph_file.h"
+#include "ground_truth.h"
+#include "greedy_search.h"
+#include "entry_points.h"
+#include "minimum_navigable_graph.h"
+#include "quantization.h"
+
+struct arguments {
+    std::string base_path;
+    std::string query_path;
+    std::string graph_path;
+    size_t sample_size;
+    size_t knn_size;
+    size_t num_pivots;
+    size_t max_rerank;
+};
+
+void parse_arguments(int argc, char *argv[], arguments &args) {
+    struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"base_path", required_argument, NULL, 'b'},
+        {"query_path", required_argument, NULL, 'q'},
+        {"graph_path", required_argument, NULL, 'g'},
+        {"sample_size", required_argument, NULL, 's'},
+        {"knn_size", required_argument, NULL, 'k'},
+        {"pivots", required_argument, NULL, 'p'},
+        {"max_rerank", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+
+    args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.query_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
+    args.graph_path = "";
+    args.sample_size = -1ULL;
+    args.knn_size = 0;
+    args.num_pivots = 16;
+    args.max_rerank = 64;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hb:q:g:s:k:p:r:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: ./quantized_search [options]" << std::endl;
+                std::cout << "Options:" << std::endl;
+                std::cout << "  -h, --help                     Show this help message" << std::endl;
+                std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
+                std::cout << "  -q, --query_path <path>        Path to the query dataset" << std::endl;
+                std::cout << "  -g, --graph_path <path>        Graph to search (default builds one from approximate nearest neighbors)" << std::endl;
+                std::cout << "  -s, --sample_size <size>       Number of points to sample from the dataset" << std::endl;
+                std::cout << "  -k, --knn_size <size>          Build from this many approximate nearest neighbors per point (default 0, exact build)" << std::endl;
+                std::cout << "  -p, --pivots <count>           Number of pivot entry points (default 16)" << std::endl;
+                std::cout << "  -r, --max_rerank <size>        Largest number of candidates reranked exactly (default 64)" << std::endl;
+                exit(EXIT_SUCCESS);
+            case 'b':
+                args.base_path = std::string(optarg);
+                break;
+            case 'q':
+                args.query_path = std::string(optarg);
+                break;
+            case 'g':
+                args.graph_path = std::string(optarg);
+                break;
+            case 's':
+                args.sample_size = std::stoull(optarg);
+                break;
+            case 'k':
+                args.knn_size = std::stoull(optarg);
+                break;
+            case 'p':
+                args.num_pivots = std::stoull(optarg);
+                break;
+            case 'r':
+                args.max_rerank = std::stoull(optarg);
+                break;
+            default:
+                std::cerr << "Invalid option." << std::endl;
+                exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    arguments args;
+    parse_arguments(argc, argv, args);
+
+    using index_t = uint32_t;
+    using value_t = float;
+
+    PointSet points(args.base_path.data(), args.sample_size);
+    PointSet queries(args.query_path.data(), args.query_path == args.base_path ? args.sample_size : -1ULL);
+    std::cout << "Loaded " << points.size() << " points and " << queries.size() << " queries" << std::endl;
+
+    parlay::internal::timer timer;
+    timer.start();
+    std::vector<std::vector<index_t>> adjlists;
+    if (!args.graph_path.empty()) {
+        adjlists = load_adjlists<index_t>(args.graph_path);
+        std::cout << "Loaded graph in " << timer.next_time() << " seconds" << std::endl;
+    }
+    else if (args.knn_size > 0) {
+        NNDescent::parameters knn_params;
+        knn_params.k = args.knn_size;
+        adjlists = MNG::approximate_navigable_graph<index_t, value_t>(points, knn_params);
+        std::cout << "Built graph from approximate nearest neighbors in " << timer.next_time() << " seconds" << std::endl;
+    }
+    else {
+        adjlists = MNG::minimum_navigable_graph<index_t, value_t>(points);
+        std::cout << "Built graph in " << timer.next_time() << " seconds" << std::endl;
+    }
+    EntryPoints entry(points, args.num_pivots);
+
+    // Exact nearest neighbor of every query
+    GroundTruth<value_t> ground_truth(points, queries, 1);
+
+    auto report = [&](std::string name, double query_time, auto &results) {
+        double recall = parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return results[i].first == ground_truth.id(i, 0) ? 1.0 : 0.0;
+        })) / queries.size();
+        double dist_comps = parlay::reduce(parlay::tabulate(queries.size(), [&](size_t i) {
+            return (double)results[i].second;
+        })) / queries.size();
+        std::cout << name << ": recall " << recall << ", QPS " << queries.size() / query_time
+                  << ", avg distance comparisons " << dist_comps << std::endl;
+    };
+
+    // Full-precision baseline
+    timer.start();
+    auto exact_results = parlay::tabulate(queries.size(), [&](size_t i) {
+        return greedy_search(adjlists, points, entry, queries[i]);
+    });
+    report("Full precision (" + std::to_string(points.dimension() * sizeof(value_t)) + " bytes)", timer.next_time(), exact_results);
+
+    auto run_quantizer = [&](std::string name, auto &quantizer) {
+        std::cout << name << ": " << quantizer.code_size() << " bytes per point ("
+                  << points.dimension() * sizeof(value_t) / (double)quantizer.code_size() << "x compression)" << std::endl;
+        for (size_t rerank = 1; rerank <= args.max_rerank; rerank *= 4) {
+            timer.start();
+            auto quantized_results = parlay::tabulate(queries.size(), [&](size_t i) {
+                return quantized_search(adjlists, points, quantizer, entry, queries[i], rerank);
+            });
+            double query_time = timer.next_time();
+            auto results = parlay::map(quantized_results, [](auto &result) {
+                return std::make_pair(result.id, result.exact);
+            });
+            double estimates = parlay::reduce(parlay::map(quantized_results, [](auto &result) {
+                return (double)result.estimates;
+            })) / queries.size();
+            report("  rerank " + std::to_string(rerank), query_time, results);
+            std::cout << "    avg estimated distances " << estimates << std::endl;
+        }
+    };
+
+    for (size_t bits : {8, 4}) {
+        timer.start();
+        ScalarQuantizer<value_t> quantizer(points, bits);
+        std::cout << "Trained SQ" << bits << " in " << timer.next_time() << " seconds" << std::endl;
+        run_quantizer("SQ" + std::to_string(bits), quantizer);
+    }
+    for (size_t divisor : {4, 8}) {
+        size_t num_subspaces = std::max<size_t>(1, points.dimension() / divisor);
+        timer.start();
+        ProductQuantizer<value_t> quantizer(points, num_subspaces);
+        std::cout << "Trained PQ" << num_subspaces << " in " << timer.next_time() << " seconds" << std::endl;
+        run_quantizer("PQ" + std::to_string(num_subspaces), quantizer);
+    }
+
+    return 0;
+}
@@ -2,7 +2,6 @@
 #include <cstdint>
 #include <cstring>
 #include <random>
-#include <mutex>
 #include <getopt.h>
 
 #include <parlay/sequence.h>
@@ -17,11 +16,19 @@
 
 #include "point_set.h"
 #include "greedy_search.h"
+#include "entry_points.h"
+#include "robust_prune.h"
 
 struct arguments {
     std::string base_path;
     std::string query_path;
     size_t sample_size;
+    double alpha;
+    size_t max_degree;
+    size_t candidate_size;
+    size_t num_pivots;
+    bool order_dimensions;
+    bool candidate_rule;
 };
 
 void parse_arguments(int argc, char *argv[], arguments &args) {
@@ -30,15 +37,27 @@ void parse_arguments(int argc, char *argv[], arguments &args) {
         {"base_path", required_argument, NULL, 'b'},
         {"query_path", required_argument, NULL, 'q'},
         {"sample_size", required_argument, NULL, 's'},
+        {"alpha", required_argument, NULL, 'a'},
+        {"max_degree", required_argument, NULL, 'R'},
+        {"candidate_size", required_argument, NULL, 'L'},
+        {"pivots", required_argument, NULL, 'p'},
+        {"order_dimensions", no_argument, NULL, 'o'},
+        {"candidate_rule", no_argument, NULL, 'A'},
         {NULL, 0, NULL, 0}
     };
 
     args.base_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
     args.query_path = "/ssd1/richard/navgraphs/sift_10K.fbin";
     args.sample_size = -1ULL;
+    args.alpha = 1.0;
+    args.max_degree = -1ULL;
+    args.candidate_size = -1ULL;
+    args.num_pivots = 16;
+    args.order_dimensions = false;
+    args.candidate_rule = false;
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "hb:q:s:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hb:q:s:a:R:L:p:oA", long_options, NULL)) != -1) {
         switch (opt) {
             case 'h':
                 std::cout << "Usage: ./prune_neighborhood [options]" << std::endl;
@@ -47,6 +66,12 @@ void parse_arguments(int argc, char *argv[], arguments &args) {
                 std::cout << "  -b, --base_path <path>         Path to the base dataset" << std::endl;
                 std::cout << "  -q, --query_path <path>        Path to the query dataset" << std::endl;
                 std::cout << "  -s, --sample_size <size>       Number of points to sample from the dataset" << std::endl;
+                std::cout << "  -a, --alpha <alpha>            Pruning parameter (default 1.0)" << std::endl;
+                std::cout << "  -R, --max_degree <degree>      Maximum degree (default unbounded)" << std::endl;
+                std::cout << "  -L, --candidate_size <size>    Number of candidates per vertex (default all points)" << std::endl;
+                std::cout << "  -p, --pivots <count>           Number of pivot entry points for search (default 16)" << std::endl;
+                std::cout << "  -o, --order_dimensions         Reorder dimensions by decreasing variance so distances stop earlier" << std::endl;
+                std::cout << "  -A, --candidate_rule           Prune u by w if alpha * d(w, u) < d(v, u) rather than d(v, w), keeping fewer edges" << std::endl;
                 exit(EXIT_SUCCESS);
             case 'b':
                 args.base_path = std::string(optarg);
@@ -57,6 +82,24 @@ void parse_arguments(int argc, char *argv[], arguments &args) {
             case 's':
                 args.sample_size = std::stoull(optarg);
                 break;
+            case 'a':
+                args.alpha = std::stod(optarg);
+                break;
+            case 'R':
+                args.max_degree = std::stoull(optarg);
+                break;
+            case 'L':
+                args.candidate_size = std::stoull(optarg);
+                break;
+            case 'p':
+                args.num_pivots = std::stoull(optarg);
+                break;
+            case 'o':
+                args.order_dimensions = true;
+                break;
+            case 'A':
+                args.candidate_rule = true;
+                break;
             default:
                 std::cerr << "Invalid option." << std::endl;
                 exit(EXIT_FAILURE);
@@ -75,48 +118,18 @@ int main(int argc, char *argv[]) {
 
     PointSet points(args.base_path.data(), args.sample_size);
     PointSet queries(args.query_path.data());
+    if (args.order_dimensions) {
+        auto order = variance_order(points);
+        points.reorder_dimensions(order);
+        queries.reorder_dimensions(order);
+    }
 
-    size_t progress = 0, max_progress = points.size();
-    std::mutex progress_lock;
+    // The neighbor rule d(u, w) < d(v, w) is the one this experiment has always used
+    Prune::parameters params(args.alpha, args.max_degree, args.candidate_size, !args.candidate_rule);
+    std::cout << "Prune rule: " << (args.candidate_rule ? "alpha * d(w, u) < d(v, u)" : "alpha * d(w, u) < d(v, w)") << std::endl;
     parlay::internal::timer timer;
     timer.start();
-    auto neighbors = parlay::tabulate(points.size(), [&](size_t v) {
-        std::vector<index_t> candidates;
-        candidates.reserve(points.size() - 1);
-        for (size_t j = 0; j < points.size(); j++) {
-            if (j != v) candidates.push_back(j);
-        }
-        std::vector<value_t> distances;
-        distances.reserve(points.size());
-        for (size_t j = 0; j < points.size(); j++) {
-            distances.push_back(points[v].distance(points[j]));
-        }
-
-        std::sort(candidates.begin(), candidates.end(), [&](index_t a, index_t b) {
-            return distances[a] < distances[b];
-        });
-
-        std::vector<index_t> curr_neighbors;
-        for (index_t u : candidates) {
-            if (u == v) continue;
-
-            bool add = true;
-            for (index_t w : curr_neighbors) {
-                value_t vw_dist = distances[w];
-                value_t uw_dist = points[u].distance(points[w]);
-                if (uw_dist < vw_dist) {
-                    add = false;
-                    break;
-                }
-            }
-
-            if (add) curr_neighbors.push_back(u);
-        }
-
-        std::lock_guard lock(progress_lock);
-        std::cout << "\rProgress: " << ++progress << "/" << max_progress << std::flush;
-        return curr_neighbors;
-    });
+    auto neighbors = Prune::prune_graph<index_t>(points, params, true);
     std::cout << std::endl;
     std::cout << "Computed neighbors in " << timer.next_time() << " seconds" << std::endl;
 
@@ -128,9 +141,12 @@ int main(int argc, char *argv[]) {
     std::cout << "Max degree: " << max_degree << std::endl;
     std::cout << "Avg degree: " << avg_degree << std::endl;
 
+    EntryPoints entry(points, args.num_pivots);
+    std::cout << "Entry points: " << entry.size() << " (medoid " << entry.pivots[0] << ")" << std::endl;
+
     timer.start();
     auto results = parlay::tabulate(points.size(), [&](size_t i) {
-        auto [neighbor, dist_comps] = greedy_search(neighbors, points, 0, i);
+        auto [neighbor, dist_comps] = greedy_search(neighbors, points, entry, i);
         return std::make_pair(neighbor, dist_comps);
     });
     double query_time = timer.next_time();